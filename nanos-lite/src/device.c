@@ -1,8 +1,19 @@
 #include "common.h"
 #include <amdev.h>
 
+static _Device *serial_dev = NULL;
+
 size_t serial_write(const void *buf, size_t offset, size_t len) {
-  return 0;
+  if (serial_dev != NULL) {
+    // send the whole buffer in one transfer
+    return serial_dev->write(_DEVREG_SERIAL_SEND, (void *)buf, len);
+  }
+
+  const char *p = buf;
+  for (size_t i = 0; i < len; i ++) {
+    _putc(p[i]);
+  }
+  return len;
 }
 
 #define NAME(key) \
@@ -31,6 +42,14 @@ void init_device() {
   Log("Initializing devices...");
   _ioe_init();
 
+  _Device *dev;
+  for (int n = 1; (dev = _device(n)) != NULL; n ++) {
+    if (dev->id == _DEV_SERIAL) {
+      serial_dev = dev;
+      break;
+    }
+  }
+
   // TODO: print the string to array `dispinfo` with the format
   // described in the Navy-apps convention
 }
@@ -1,14 +1,17 @@
 #include "common.h"
-
-extern uint8_t ramdisk_start;
-extern uint8_t ramdisk_end;
-#define RAMDISK_SIZE ((&ramdisk_end) - (&ramdisk_start))
+#include <amdev.h>
 
 /* The kernel is monolithic, therefore we do not need to
  * translate the address `buf' from the user process to
  * a physical one, which is necessary for a microkernel.
  */
 
+#ifndef HAS_DISK
+
+extern uint8_t ramdisk_start;
+extern uint8_t ramdisk_end;
+#define RAMDISK_SIZE ((&ramdisk_end) - (&ramdisk_start))
+
 /* read `len' bytes starting from `offset' of ramdisk into `buf' */
 size_t ramdisk_read(void *buf, size_t offset, size_t len) {
   assert(offset + len <= RAMDISK_SIZE);
@@ -31,3 +34,97 @@ void init_ramdisk() {
 size_t get_ramdisk_size() {
   return RAMDISK_SIZE;
 }
+
+#else
+
+/* The ramdisk is the paravirtual disk of NEMU. Whole sectors are
+ * transferred to/from `buf' directly, and only the partial sectors
+ * at both ends go through `sect_buf'.
+ */
+
+#define SECTOR_SIZE 512
+
+static _Device *disk_dev;
+static uint32_t disk_nsect;
+static uint8_t sect_buf[SECTOR_SIZE];
+
+size_t get_ramdisk_size();
+
+static void disk_io(int is_write, void *buf, uint32_t sect, uint32_t nsect) {
+  _BlkIOReg io = { .sect = sect, .nsect = nsect, .buf = buf };
+  size_t ret = (is_write ? disk_dev->write : disk_dev->read)(_DEVREG_ATA_BLKIO, &io, sizeof(io));
+  assert(ret == sizeof(io));
+}
+
+static size_t ramdisk_rw(int is_write, uint8_t *buf, size_t offset, size_t len) {
+  assert(offset + len <= get_ramdisk_size());
+  size_t left = len;
+
+  // partial sector at the beginning
+  uint32_t sect = offset / SECTOR_SIZE;
+  size_t skip = offset % SECTOR_SIZE;
+  if (skip != 0 && left > 0) {
+    size_t n = SECTOR_SIZE - skip;
+    if (n > left) n = left;
+    disk_io(false, sect_buf, sect, 1);
+    if (is_write) {
+      memcpy(sect_buf + skip, buf, n);
+      disk_io(true, sect_buf, sect, 1);
+    }
+    else {
+      memcpy(buf, sect_buf + skip, n);
+    }
+    buf += n;
+    left -= n;
+    sect ++;
+  }
+
+  // whole sectors in one transfer
+  uint32_t nsect = left / SECTOR_SIZE;
+  if (nsect > 0) {
+    disk_io(is_write, buf, sect, nsect);
+    buf += nsect * SECTOR_SIZE;
+    left -= nsect * SECTOR_SIZE;
+    sect += nsect;
+  }
+
+  // partial sector at the end
+  if (left > 0) {
+    disk_io(false, sect_buf, sect, 1);
+    if (is_write) {
+      memcpy(sect_buf, buf, left);
+      disk_io(true, sect_buf, sect, 1);
+    }
+    else {
+      memcpy(buf, sect_buf, left);
+    }
+  }
+
+  return len;
+}
+
+size_t ramdisk_read(void *buf, size_t offset, size_t len) {
+  return ramdisk_rw(false, buf, offset, len);
+}
+
+size_t ramdisk_write(const void *buf, size_t offset, size_t len) {
+  return ramdisk_rw(true, (void *)buf, offset, len);
+}
+
+void init_ramdisk() {
+  for (int n = 1; (disk_dev = _device(n)) != NULL; n ++) {
+    if (disk_dev->id == _DEV_ATA0) break;
+  }
+  assert(disk_dev != NULL);
+
+  _BlkInfoReg info;
+  disk_dev->read(_DEVREG_ATA_BLKINFO, &info, sizeof(info));
+  disk_nsect = info.nsect;
+  Log("ramdisk info: %s, size = %d bytes", disk_dev->name, get_ramdisk_size());
+}
+
+size_t get_ramdisk_size() {
+  return disk_nsect * SECTOR_SIZE;
+}
+
+#endif
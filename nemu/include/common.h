@@ -3,16 +3,33 @@
 
 #define DEBUG
 //#define DIFF_TEST
+//#define OPCODE_PROFILE
+//#define CACHE_SIM
+//#define BRANCH_PROF
+//#define MEM_TRACE
 
 #if _SHARE
 // do not enable these features while building a reference design
 #undef DIFF_TEST
 #undef DEBUG
+#undef OPCODE_PROFILE
+#undef CACHE_SIM
+#undef BRANCH_PROF
+#undef MEM_TRACE
 #endif
 
 /* You will define this macro in PA2 */
 //#define HAS_IOE
 
+/* The state of a guest is thread-local in the shared library, so that
+ * independent guests can run in different threads (see libnemu.c).
+ */
+#if _SHARE
+#define NEMU_TLS __thread
+#else
+#define NEMU_TLS
+#endif
+
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
@@ -0,0 +1,25 @@
+#ifndef __CPU_BRANCH_H__
+#define __CPU_BRANCH_H__
+
+#include "common.h"
+
+/* Profiling of the guest branches with a simulated branch predictor,
+ * enabled by BRANCH_PROF in include/common.h. */
+
+enum { BR_COND, BR_DIRECT, BR_INDIRECT };
+
+#ifdef BRANCH_PROF
+
+void init_branch_prof(const char *spec);
+void branch_profile(vaddr_t pc, vaddr_t target, int type, bool taken);
+void branch_report();
+
+#define branch_prof(pc, target, type, taken) branch_profile(pc, target, type, taken)
+
+#else
+
+#define branch_prof(pc, target, type, taken)
+
+#endif
+
+#endif
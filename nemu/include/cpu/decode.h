@@ -6,6 +6,7 @@
 #include "rtl.h"
 
 enum { OP_TYPE_REG, OP_TYPE_MEM, OP_TYPE_IMM };
+enum { PREFIX_NONE, PREFIX_REP, PREFIX_REPNE };
 
 #define OP_STR_SIZE 40
 
@@ -26,6 +27,7 @@ typedef struct {
   uint32_t opcode;
   vaddr_t seq_eip;  // sequential eip
   bool is_operand_size_16;
+  uint8_t rep_prefix;
   uint8_t ext_opcode;
   bool is_jmp;
   vaddr_t jmp_eip;
@@ -64,8 +66,15 @@ void read_ModR_M(vaddr_t *, Operand *, bool, Operand *, bool);
 
 void operand_write(Operand *, rtlreg_t *);
 
+/* the same as operand_write(), but with a constant `width' */
+static inline void operand_writeW(Operand *op, rtlreg_t* src, const int width) {
+  if (op->type == OP_TYPE_REG) { rtl_sr(op->reg, src, width); }
+  else if (op->type == OP_TYPE_MEM) { rtl_sm(&op->addr, src, width); }
+  else { assert(0); }
+}
+
 /* shared by all helper functions */
-extern DecodeInfo decoding;
+extern NEMU_TLS DecodeInfo decoding;
 
 #define id_src (&decoding.src)
 #define id_src2 (&decoding.src2)
@@ -74,43 +83,59 @@ extern DecodeInfo decoding;
 #define make_DHelper(name) void concat(decode_, name) (vaddr_t *eip)
 typedef void (*DHelper) (vaddr_t *);
 
-make_DHelper(I2E);
-make_DHelper(I2a);
-make_DHelper(I2r);
-make_DHelper(SI2E);
-make_DHelper(SI_E2G);
-make_DHelper(I_E2G);
-make_DHelper(I_G2E);
-make_DHelper(I);
-make_DHelper(r);
-make_DHelper(E);
-make_DHelper(setcc_E);
-make_DHelper(gp7_E);
-make_DHelper(test_I);
-make_DHelper(SI);
-make_DHelper(G2E);
-make_DHelper(E2G);
-
-make_DHelper(mov_I2r);
-make_DHelper(mov_I2E);
-make_DHelper(mov_G2E);
-make_DHelper(mov_E2G);
-make_DHelper(lea_M2G);
-
-make_DHelper(gp2_1_E);
-make_DHelper(gp2_cl2E);
-make_DHelper(gp2_Ib2E);
-
-make_DHelper(O2a);
-make_DHelper(a2O);
-
-make_DHelper(J);
-
-make_DHelper(push_SI);
-
-make_DHelper(in_I2a);
-make_DHelper(in_dx2a);
-make_DHelper(out_a2I);
-make_DHelper(out_a2dx);
+/* Define the body of a helper with a constant `width', and instantiate
+ * it for 8, 16 and 32-bit operands as decode_name_b/_w/_l. */
+#define make_DHelperW(name) \
+  static inline __attribute__((always_inline)) \
+    void concat(decode_body_, name) (vaddr_t *eip, const int width); \
+  make_DHelper(concat(name, _b)) { concat(decode_body_, name) (eip, 1); } \
+  make_DHelper(concat(name, _w)) { concat(decode_body_, name) (eip, 2); } \
+  make_DHelper(concat(name, _l)) { concat(decode_body_, name) (eip, 4); } \
+  static inline __attribute__((always_inline)) \
+    void concat(decode_body_, name) (vaddr_t *eip, const int width)
+
+#define declare_DHelperW(name) \
+  make_DHelper(concat(name, _b)); \
+  make_DHelper(concat(name, _w)); \
+  make_DHelper(concat(name, _l))
+
+declare_DHelperW(I2E);
+declare_DHelperW(I2a);
+declare_DHelperW(I2r);
+declare_DHelperW(SI2E);
+declare_DHelperW(SI_E2G);
+declare_DHelperW(I_E2G);
+declare_DHelperW(I_G2E);
+declare_DHelperW(I);
+declare_DHelperW(r);
+declare_DHelperW(E);
+declare_DHelperW(setcc_E);
+declare_DHelperW(gp7_E);
+declare_DHelperW(test_I);
+declare_DHelperW(SI);
+declare_DHelperW(G2E);
+declare_DHelperW(E2G);
+
+declare_DHelperW(mov_I2r);
+declare_DHelperW(mov_I2E);
+declare_DHelperW(mov_G2E);
+declare_DHelperW(mov_E2G);
+declare_DHelperW(lea_M2G);
+
+declare_DHelperW(gp2_1_E);
+declare_DHelperW(gp2_cl2E);
+declare_DHelperW(gp2_Ib2E);
+
+declare_DHelperW(O2a);
+declare_DHelperW(a2O);
+
+declare_DHelperW(J);
+
+declare_DHelperW(push_SI);
+
+declare_DHelperW(in_I2a);
+declare_DHelperW(in_dx2a);
+declare_DHelperW(out_a2I);
+declare_DHelperW(out_a2dx);
 
 #endif
@@ -6,10 +6,27 @@
 #define make_EHelper(name) void concat(exec_, name) (vaddr_t *eip)
 typedef void (*EHelper) (vaddr_t *);
 
+/* Define the body of a helper with a constant `width', and instantiate
+ * it for 8, 16 and 32-bit operands as exec_name_b/_w/_l. */
+#define make_EHelperW(name) \
+  static inline __attribute__((always_inline)) \
+    void concat(exec_body_, name) (vaddr_t *eip, const int width); \
+  make_EHelper(concat(name, _b)) { concat(exec_body_, name) (eip, 1); } \
+  make_EHelper(concat(name, _w)) { concat(exec_body_, name) (eip, 2); } \
+  make_EHelper(concat(name, _l)) { concat(exec_body_, name) (eip, 4); } \
+  static inline __attribute__((always_inline)) \
+    void concat(exec_body_, name) (vaddr_t *eip, const int width)
+
+#define declare_EHelperW(name) \
+  make_EHelper(concat(name, _b)); \
+  make_EHelper(concat(name, _w)); \
+  make_EHelper(concat(name, _l))
+
 #include "cpu/decode.h"
 
 static inline uint32_t instr_fetch(vaddr_t *eip, int len) {
   uint32_t instr = vaddr_read(*eip, len);
+  cache_sim(*eip, len, CACHE_IFETCH);
 #ifdef DEBUG
   uint8_t *p_instr = (void *)&instr;
   int i;
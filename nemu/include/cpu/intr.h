@@ -0,0 +1,46 @@
+#ifndef __CPU_INTR_H__
+#define __CPU_INTR_H__
+
+#include "common.h"
+
+/* The interrupt controller. A device raises an IRQ line, which stays
+ * pending in a bitmap until the CPU takes it through vector
+ * IRQ_BASE + line. Raising a line which is already pending is merged.
+ *
+ * The bitmap is only checked at the end of a basic block (including iret),
+ * and after sti and popf, which may set eflags.IF, so that the other
+ * instructions pay nothing. The instructions between raising and taking
+ * an IRQ are reported as its latency.
+ *
+ * Devices raise lines between instructions, in device_update(), and never
+ * from a signal handler.
+ */
+
+#define IRQ_BASE 32
+
+enum { IRQ_TIMER, NR_IRQ };
+
+extern NEMU_TLS uint32_t intr_pending;
+/* set by sti and popf, see exec_wrapper() */
+extern NEMU_TLS bool intr_recheck;
+
+void dev_raise_irq(int irq);
+bool intr_take();
+void intr_idt_flush();
+void intr_report();
+
+/* Called at the end of a block, with cpu.eip pointing to the next one.
+ * Return whether the CPU has entered the handler of an IRQ. */
+static inline bool intr_check() {
+  return intr_pending != 0 && intr_take();
+}
+
+/* The vectors looked up from the IDT are cached, so a store to the IDT
+ * flushes the cache. Nothing is watched while the cache is empty. */
+extern NEMU_TLS vaddr_t idt_watch_lo, idt_watch_hi;
+
+static inline void idt_watch(vaddr_t addr, uint32_t len) {
+  if (addr < idt_watch_hi && addr + len > idt_watch_lo) { intr_idt_flush(); }
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __CPU_PERFCNT_H__
+#define __CPU_PERFCNT_H__
+
+#include "common.h"
+
+/* Guest events counted by the CPU, see also src/device/perfcnt.c */
+typedef struct {
+  uint64_t load, store;
+  uint64_t branch_taken;
+  uint64_t tlb_miss;
+  uint64_t intr;
+} PerfCnt;
+
+extern NEMU_TLS PerfCnt perfcnt;
+
+#endif
@@ -2,6 +2,7 @@
 #define __REG_H__
 
 #include "common.h"
+#include "memory/mmu.h"
 
 enum { R_EAX, R_ECX, R_EDX, R_EBX, R_ESP, R_EBP, R_ESI, R_EDI };
 enum { R_AX, R_CX, R_DX, R_BX, R_SP, R_BP, R_SI, R_DI };
@@ -33,9 +34,29 @@ typedef struct {
 
   vaddr_t eip;
 
+  /* The registers below are not compared by difftest, and only eflags
+   * and cs are copied to the reference by difftest_setregs(). */
+
+  union {
+    struct {
+      uint32_t CF : 1, : 5, ZF : 1, SF : 1, : 1, IF : 1, : 1, OF : 1, : 20;
+    };
+    uint32_t val;
+  } eflags;
+
+  rtlreg_t cs;
+
+  struct {
+    uint16_t limit;
+    vaddr_t base;
+  } idtr;
+
+  CR0 cr0;
+  CR3 cr3;
+
 } CPU_state;
 
-extern CPU_state cpu;
+extern NEMU_TLS CPU_state cpu;
 
 static inline int check_reg_index(int index) {
   assert(index >= 0 && index < 8);
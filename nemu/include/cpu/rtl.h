@@ -5,8 +5,16 @@
 #include "util/c_op.h"
 #include "cpu/relop.h"
 #include "cpu/rtl-wrapper.h"
+#include "cpu/perfcnt.h"
+#include "memory/cache.h"
+#include "memory/trace.h"
+#include "cpu/branch.h"
+#include "monitor/coverage.h"
+#include "cpu/intr.h"
 
-extern rtlreg_t t0, t1, t2, t3, at;
+extern NEMU_TLS rtlreg_t t0, t1, t2, t3, at;
+/* set by the instructions which end a basic block, see exec_wrapper() */
+extern NEMU_TLS bool at_block_end;
 
 void decoding_set_jmp(bool is_jmp);
 bool interpret_relop(uint32_t relop, const rtlreg_t src1, const rtlreg_t src2);
@@ -79,10 +87,16 @@ static inline void interpret_rtl_idiv64_r(rtlreg_t* dest,
 
 static inline void interpret_rtl_lm(rtlreg_t *dest, const rtlreg_t* addr, int len) {
   *dest = vaddr_read(*addr, len);
+  perfcnt.load ++;
+  cache_sim(*addr, len, CACHE_LOAD);
+  mem_trace(TRACE_LOAD, *addr, len, *dest);
 }
 
 static inline void interpret_rtl_sm(const rtlreg_t* addr, const rtlreg_t* src1, int len) {
   vaddr_write(*addr, *src1, len);
+  perfcnt.store ++;
+  cache_sim(*addr, len, CACHE_STORE);
+  mem_trace(TRACE_STORE, *addr, len, *src1);
 }
 
 static inline void interpret_rtl_host_lm(rtlreg_t* dest, const void *addr, int len) {
@@ -109,20 +123,29 @@ static inline void interpret_rtl_setrelop(uint32_t relop, rtlreg_t *dest,
 }
 
 static inline void interpret_rtl_j(vaddr_t target) {
+  branch_prof(cpu.eip, target, BR_DIRECT, true);
   cpu.eip = target;
   decoding_set_jmp(true);
+  at_block_end = true;
+  perfcnt.branch_taken ++;
 }
 
 static inline void interpret_rtl_jr(rtlreg_t *target) {
+  branch_prof(cpu.eip, *target, BR_INDIRECT, true);
   cpu.eip = *target;
   decoding_set_jmp(true);
+  at_block_end = true;
+  perfcnt.branch_taken ++;
 }
 
 static inline void interpret_rtl_jrelop(uint32_t relop,
     const rtlreg_t *src1, const rtlreg_t *src2, vaddr_t target) {
   bool is_jmp = interpret_relop(relop, *src1, *src2);
+  branch_prof(cpu.eip, target, BR_COND, is_jmp);
   if (is_jmp) cpu.eip = target;
   decoding_set_jmp(is_jmp);
+  perfcnt.branch_taken += is_jmp;
+  at_block_end = true;
 }
 
 void interpret_rtl_exit(int state);
@@ -161,13 +184,15 @@ static inline void rtl_sext(rtlreg_t* dest, const rtlreg_t* src1, int width) {
 static inline void rtl_push(const rtlreg_t* src1) {
   // esp <- esp - 4
   // M[esp] <- src1
-  TODO();
+  rtl_subi(&cpu.esp, &cpu.esp, 4);
+  rtl_sm(&cpu.esp, src1, 4);
 }
 
 static inline void rtl_pop(rtlreg_t* dest) {
   // dest <- M[esp]
   // esp <- esp + 4
-  TODO();
+  rtl_lm(dest, &cpu.esp, 4);
+  rtl_addi(&cpu.esp, &cpu.esp, 4);
 }
 
 static inline void rtl_setrelopi(uint32_t relop, rtlreg_t *dest,
@@ -178,15 +203,16 @@ static inline void rtl_setrelopi(uint32_t relop, rtlreg_t *dest,
 
 static inline void rtl_msb(rtlreg_t* dest, const rtlreg_t* src1, int width) {
   // dest <- src1[width * 8 - 1]
-  TODO();
+  rtl_shri(dest, src1, width * 8 - 1);
+  rtl_andi(dest, dest, 0x1);
 }
 
 #define make_rtl_setget_eflags(f) \
   static inline void concat(rtl_set_, f) (const rtlreg_t* src) { \
-    TODO(); \
+    cpu.eflags.f = *src; \
   } \
   static inline void concat(rtl_get_, f) (rtlreg_t* dest) { \
-    TODO(); \
+    *dest = cpu.eflags.f; \
   }
 
 make_rtl_setget_eflags(CF)
@@ -196,12 +222,12 @@ make_rtl_setget_eflags(SF)
 
 static inline void rtl_update_ZF(const rtlreg_t* result, int width) {
   // eflags.ZF <- is_zero(result[width * 8 - 1 .. 0])
-  TODO();
+  cpu.eflags.ZF = ((*result & (~0u >> ((4 - width) * 8))) == 0);
 }
 
 static inline void rtl_update_SF(const rtlreg_t* result, int width) {
   // eflags.SF <- is_sign(result[width * 8 - 1 .. 0])
-  TODO();
+  cpu.eflags.SF = (*result >> (width * 8 - 1)) & 0x1;
 }
 
 static inline void rtl_update_ZFSF(const rtlreg_t* result, int width) {
@@ -0,0 +1,24 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include "common.h"
+
+/* Record and replay of the nondeterministic inputs of the devices.
+ * In record mode, every RTC read, key event and timer interrupt is
+ * appended to a journal together with the guest instruction count
+ * at which it happens. In replay mode, these inputs are fed back from
+ * the journal at exactly the same instruction counts, without SDL and
+ * without the host timer.
+ */
+
+enum { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+enum { REPLAY_EV_RTC = 1, REPLAY_EV_KEY, REPLAY_EV_TIMER };
+
+void init_replay(int mode, const char *file);
+int replay_mode();
+
+void replay_record(int type, uint32_t data);
+uint32_t replay_rtc(uint32_t val);
+void replay_update();
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include "common.h"
+
+/* In virtual time mode, the time seen by the guest and the timer interrupts
+ * are derived from the number of guest instructions executed, assuming the
+ * guest runs at a nominal frequency of `mhz' MHz. This makes the timing of
+ * the guest independent of the host load.
+ */
+void init_vclock(uint32_t mhz);
+bool vclock_enabled();
+uint64_t vclock_us();
+uint64_t vclock_instr_per_sec();
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __LIBNEMU_H__
+#define __LIBNEMU_H__
+
+/* The API of NEMU as a shared library (built with `make SHARE=1').
+ *
+ * Every instance is an independent guest with its own registers and
+ * physical memory. Different instances can run in different threads at
+ * the same time, but an instance must not be used by two threads at the
+ * same time. Devices are not available in the library.
+ */
+
+#include <stdint.h>
+
+typedef struct NEMU NEMU;
+
+enum { NEMU_LIB_STOP, NEMU_LIB_RUNNING, NEMU_LIB_END, NEMU_LIB_ABORT };
+
+/* create a guest with `mem_mb' MB of physical memory (0 for the default) */
+NEMU* nemu_create(uint32_t mem_mb);
+
+/* load an ELF or a raw binary image, return its size or -1 on failure */
+long nemu_load(NEMU *nemu, const char *img_file);
+
+/* execute at most `n' instructions, and return the state of the guest */
+int nemu_run(NEMU *nemu, uint64_t n);
+
+/* the value passed to nemu_trap, valid when the state is NEMU_LIB_END */
+uint32_t nemu_exit_code(NEMU *nemu);
+
+uint64_t nemu_instr_count(NEMU *nemu);
+
+void nemu_destroy(NEMU *nemu);
+
+#endif
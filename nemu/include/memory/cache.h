@@ -0,0 +1,30 @@
+#ifndef __MEMORY_CACHE_H__
+#define __MEMORY_CACHE_H__
+
+#include "common.h"
+
+/* A simulator of the cache hierarchy (L1I, L1D and a unified L2) seen by
+ * the guest, enabled by CACHE_SIM in include/common.h. It only counts
+ * hits and misses, the memory is still accessed directly.
+ */
+
+enum { CACHE_IFETCH, CACHE_LOAD, CACHE_STORE };
+
+#ifdef CACHE_SIM
+
+void init_cache(const char *spec);
+void cache_report();
+void cache_access(vaddr_t addr, int len, int type);
+void cache_access_run(vaddr_t addr, uint32_t n, int width, int type);
+
+#define cache_sim(addr, len, type) cache_access(addr, len, type)
+#define cache_sim_run(addr, n, width, type) cache_access_run(addr, n, width, type)
+
+#else
+
+#define cache_sim(addr, len, type)
+#define cache_sim_run(addr, n, width, type)
+
+#endif
+
+#endif
@@ -3,13 +3,25 @@
 
 #include "common.h"
 
-extern uint8_t pmem[];
+#define PMEM_SIZE_DEFAULT (128 * 1024 * 1024)
+#define PMEM_SIZE_MAX (3072u * 1024 * 1024)
+
+/* how the physical memory is backed by the host */
+enum { PMEM_HUGE_NONE, PMEM_HUGE_THP, PMEM_HUGE_TLB };
+
+extern NEMU_TLS uint8_t *pmem;
+extern NEMU_TLS uint32_t pmem_size;
+
+void init_mem(uint32_t size, int huge);
+bool reset_mem();
+void mem_statistic();
 
 /* convert the guest physical address in the guest program to host virtual address in NEMU */
 #define guest_to_host(p) ((void *)(pmem + (unsigned)p))
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
 #define host_to_guest(p) ((paddr_t)((void *)p - (void *)pmem))
 
+paddr_t page_translate(vaddr_t);
 uint32_t vaddr_read(vaddr_t, int);
 uint32_t paddr_read(paddr_t, int);
 void vaddr_write(vaddr_t, uint32_t, int);
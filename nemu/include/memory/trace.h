@@ -0,0 +1,62 @@
+#ifndef __MEMORY_TRACE_H__
+#define __MEMORY_TRACE_H__
+
+#include "common.h"
+
+/* Trace of the guest memory accesses, enabled by MEM_TRACE in
+ * include/common.h and written to the file given by `-T'. The format is
+ * shared with the reader in tools/mem-trace.
+ *
+ * The file starts with a TraceHeader, followed by blocks of
+ *   uint32_t raw_len, data_len; uint8_t data[data_len];
+ * where data is compressed by zstd if the header says so. A block holds
+ * whole records, and the deltas restart from zero in each block, so that
+ * blocks can be decoded independently. A record is
+ *   uint8_t tag;          // kind, log2(width) and TRACE_NEW_EIP
+ *   varint instr;         // delta of the index of the guest instruction
+ *   varint addr;          // zigzag delta of the address (or the port)
+ *   varint eip;           // zigzag delta of eip, only with TRACE_NEW_EIP
+ *   varint value;         // the data, or the count of a run
+ * A run is a sequence of accesses to consecutive addresses, performed by
+ * a string instruction at once.
+ *
+ * The blocks still in memory are written at exit, and also on abort() by
+ * a failed Assert() or panic(), but not on other crashes of NEMU.
+ */
+
+#define TRACE_MAGIC "NEMUTRC1"
+
+enum { TRACE_RAW, TRACE_ZSTD };
+
+enum {
+  TRACE_LOAD, TRACE_STORE, TRACE_MMIO_READ, TRACE_MMIO_WRITE,
+  TRACE_PIO_IN, TRACE_PIO_OUT, TRACE_RUN_LOAD, TRACE_RUN_STORE
+};
+
+#define TRACE_KIND_MASK 0x7
+#define TRACE_WIDTH_SHIFT 3
+#define TRACE_NEW_EIP 0x20
+
+typedef struct {
+  char magic[8];
+  uint32_t compress;
+  uint32_t block_size;  // maximum raw length of a block
+} TraceHeader;
+
+#ifdef MEM_TRACE
+
+extern bool mem_trace_on;
+
+void init_mem_trace(const char *file);
+void mem_trace_record(int kind, uint32_t addr, int width, uint32_t value);
+
+#define mem_trace(kind, addr, width, value) \
+  do { if (mem_trace_on) mem_trace_record(kind, addr, width, value); } while (0)
+
+#else
+
+#define mem_trace(kind, addr, width, value)
+
+#endif
+
+#endif
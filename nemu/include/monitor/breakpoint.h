@@ -0,0 +1,29 @@
+#ifndef __BREAKPOINT_H__
+#define __BREAKPOINT_H__
+
+#include "common.h"
+
+/* Breakpoints are kept in a hash set. A bitmap of the pages holding
+ * breakpoints filters the lookups, so that the check costs nothing but
+ * one branch when there is no breakpoint, and nearly nothing on the
+ * pages without breakpoints.
+ */
+
+#define BP_PAGE_SHIFT 12
+
+extern int nr_bp;
+extern uint8_t bp_page_map[];
+
+bool bp_find(vaddr_t addr);
+bool bp_add(vaddr_t addr);
+bool bp_del(vaddr_t addr);
+int bp_list(vaddr_t *addrs, int max);
+
+static inline bool bp_check(vaddr_t addr) {
+  if (nr_bp == 0) return false;
+  uint32_t page = addr >> BP_PAGE_SHIFT;
+  if (!(bp_page_map[page >> 3] & (1 << (page & 7)))) return false;
+  return bp_find(addr);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include "common.h"
+
+/* Coverage of the guest basic blocks. A block starts at the next eip of
+ * each branch, and it is hashed into 16 bits. Like AFL, the edge from the
+ * previous block is counted in the edge map at (cur ^ prev), and the block
+ * itself is marked in the block map at cur. See tools/cov-report for how
+ * the maps are mapped back to source lines.
+ */
+
+#define COV_MAP_BITS 16
+#define COV_MAP_SIZE (1 << COV_MAP_BITS)
+
+extern NEMU_TLS uint8_t *cov_edge_map, *cov_block_map;
+extern NEMU_TLS uint32_t cov_prev;
+
+void init_coverage(const char *file);
+
+static inline uint32_t cov_hash(vaddr_t addr) {
+  return ((addr * 2654435761u) >> (32 - COV_MAP_BITS)) & (COV_MAP_SIZE - 1);
+}
+
+/* the guest has branched to the block at `addr' */
+static inline void cov_block(vaddr_t addr) {
+  if (cov_edge_map == NULL) return;
+  uint32_t cur = cov_hash(addr);
+  cov_edge_map[cur ^ cov_prev] ++;
+  cov_block_map[cur] = 1;
+  cov_prev = cur >> 1;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __MONITOR_ELF_H__
+#define __MONITOR_ELF_H__
+
+#include "common.h"
+
+/* The symbols of the image, libnemu keeps one table per instance */
+typedef struct {
+  struct Symbol *syms;
+  int nr_sym;
+  char *strtab;
+} SymTab;
+
+extern NEMU_TLS SymTab symtab;
+void free_symtab(SymTab *t);
+
+bool is_elf(const char *file);
+/* The image occupies [*start, *start + size) of the physical memory.
+ * Return its size, or -1 if the file can not be loaded. */
+long load_elf(const char *file, vaddr_t *entry, paddr_t *start);
+
+/* the function symbol containing `addr', or NULL */
+const char* elf_func_name(vaddr_t addr);
+/* the address of the symbol `name', return false if not found */
+bool elf_sym_addr(const char *name, vaddr_t *addr);
+
+#endif
@@ -1,8 +1,13 @@
 #ifndef __MONITOR_H__
 #define __MONITOR_H__
 
+#include "common.h"
+
 enum { NEMU_STOP, NEMU_RUNNING, NEMU_END, NEMU_ABORT };
-extern int nemu_state;
+extern NEMU_TLS int nemu_state;
+
+uint64_t get_nr_guest_instr();
+void set_nr_guest_instr(uint64_t);
 
 #define ENTRY_START 0x100000
 
@@ -0,0 +1,302 @@
+#include "nemu.h"
+
+#ifdef BRANCH_PROF
+
+#include "cpu/branch.h"
+#include "monitor/elf.h"
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* Every branch is recorded by its address: the times it is executed and
+ * taken, the mispredictions, and the targets of indirect jumps. A branch
+ * is mispredicted if the direction predictor gets a conditional branch
+ * wrong, or a taken branch does not find its target in the BTB.
+ *
+ * The predictor is given by `-p' in the form
+ *   gshare:12,btb=512:4
+ * that is a direction predictor (bimodal or gshare) with 2^BITS 2-bit
+ * counters, and a BTB of ENTRIES entries in WAYS ways with LRU
+ * replacement. gshare indexes the counters by the address xor the
+ * global history of BITS branches.
+ */
+
+enum { PRED_BIMODAL, PRED_GSHARE };
+
+static const char *pred_name[] = { "bimodal", "gshare" };
+static const char *type_name[] = { "cond", "direct", "indirect" };
+
+static int pred = PRED_GSHARE;
+static int pred_bits = 12;
+static uint8_t *counter = NULL;
+static uint32_t history = 0;
+
+typedef struct {
+  vaddr_t pc, target;
+  uint64_t stamp;
+  bool valid;
+} BTBEntry;
+
+static uint32_t btb_entries = 512, btb_ways = 4;
+static uint32_t btb_set_mask;
+static BTBEntry *btb = NULL;
+static uint64_t btb_clock = 0;
+static uint64_t btb_lookup = 0, btb_miss = 0;
+
+/* branch sites in an open addressing hash table, a slot is empty if
+ * its count is zero */
+
+#define NR_TARGET 4
+#define INIT_CAP 1024
+
+typedef struct {
+  vaddr_t pc;
+  int type;
+  uint64_t count, taken, miss;
+  vaddr_t target[NR_TARGET];
+  uint64_t target_count[NR_TARGET];
+  uint64_t other_target;
+} Site;
+
+static Site *site = NULL;
+static uint32_t cap = 0, nr_site = 0;
+
+static inline uint32_t hash(vaddr_t pc) {
+  return (pc * 2654435761u) & (cap - 1);
+}
+
+static Site *site_insert(vaddr_t pc) {
+  uint32_t i;
+  for (i = hash(pc); site[i].count != 0; i = (i + 1) & (cap - 1));
+  site[i].pc = pc;
+  return &site[i];
+}
+
+static void resize(uint32_t new_cap) {
+  Site *old = site;
+  uint32_t old_cap = cap, i;
+
+  cap = new_cap;
+  site = calloc(cap, sizeof(Site));
+  Assert(site, "Can not allocate the branch table");
+  for (i = 0; i < old_cap; i ++) {
+    if (old[i].count != 0) { *site_insert(old[i].pc) = old[i]; }
+  }
+  free(old);
+}
+
+static inline Site *site_find(vaddr_t pc) {
+  uint32_t i;
+  for (i = hash(pc); site[i].count != 0; i = (i + 1) & (cap - 1)) {
+    if (site[i].pc == pc) return &site[i];
+  }
+  /* keep the load factor below 1/2 */
+  if ((nr_site + 1) * 2 > cap) { resize(cap * 2); }
+  nr_site ++;
+  return site_insert(pc);
+}
+
+static void site_add_target(Site *s, vaddr_t target) {
+  int i;
+  for (i = 0; i < NR_TARGET; i ++) {
+    if (s->target_count[i] == 0) { s->target[i] = target; }
+    if (s->target[i] == target) {
+      s->target_count[i] ++;
+      return;
+    }
+  }
+  s->other_target ++;
+}
+
+/* return whether the BTB gives `target' for `pc', and remember it */
+static bool btb_predict(vaddr_t pc, vaddr_t target) {
+  BTBEntry *set = &btb[((pc >> 2) & btb_set_mask) * btb_ways];
+  BTBEntry *victim = &set[0];
+  btb_lookup ++;
+  btb_clock ++;
+
+  uint32_t i;
+  for (i = 0; i < btb_ways; i ++) {
+    if (set[i].valid && set[i].pc == pc) {
+      bool hit = (set[i].target == target);
+      set[i].target = target;
+      set[i].stamp = btb_clock;
+      if (!hit) { btb_miss ++; }
+      return hit;
+    }
+    if (!set[i].valid) { victim = &set[i]; }
+    else if (victim->valid && set[i].stamp < victim->stamp) { victim = &set[i]; }
+  }
+
+  btb_miss ++;
+  victim->pc = pc;
+  victim->target = target;
+  victim->stamp = btb_clock;
+  victim->valid = true;
+  return false;
+}
+
+/* return whether the direction of the conditional branch at `pc' is
+ * predicted correctly, and train the predictor */
+static bool dir_predict(vaddr_t pc, bool taken) {
+  uint32_t mask = (1u << pred_bits) - 1;
+  uint32_t idx = (pred == PRED_GSHARE ? (pc ^ history) : pc) & mask;
+  uint8_t *c = &counter[idx];
+  bool hit = ((*c >= 2) == taken);
+
+  if (taken) { if (*c < 3) (*c) ++; }
+  else { if (*c > 0) (*c) --; }
+  history = ((history << 1) | taken) & mask;
+  return hit;
+}
+
+void branch_profile(vaddr_t pc, vaddr_t target, int type, bool taken) {
+  Site *s = site_find(pc);
+  s->count ++;
+  s->type = type;
+  s->taken += taken;
+
+  bool hit = true;
+  if (type == BR_COND) { hit = dir_predict(pc, taken); }
+  if (taken) {
+    /* the BTB is trained even if the direction is mispredicted */
+    hit = btb_predict(pc, target) && hit;
+  }
+  s->miss += !hit;
+
+  if (type == BR_INDIRECT) { site_add_target(s, target); }
+}
+
+static void parse_spec(const char *spec) {
+  char *buf = strdup(spec);
+  char *save = NULL, *item;
+  for (item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+    char *p;
+    if (strncmp(item, "btb=", 4) == 0) {
+      btb_entries = strtoul(item + 4, &p, 10);
+      if (*p == ':') { btb_ways = strtoul(p + 1, &p, 10); }
+    }
+    else {
+      int i;
+      for (i = 0; i < sizeof(pred_name) / sizeof(pred_name[0]); i ++) {
+        int len = strlen(pred_name[i]);
+        if (strncmp(item, pred_name[i], len) == 0 && (item[len] == ':' || item[len] == '\0')) break;
+      }
+      if (i == sizeof(pred_name) / sizeof(pred_name[0])) {
+        panic("Unknown branch predictor '%s', use bimodal or gshare", item);
+      }
+      pred = i;
+      p = item + strlen(pred_name[i]);
+      if (*p == ':') { pred_bits = strtoul(p + 1, &p, 10); }
+    }
+    if (*p != '\0') { panic("Bad branch predictor configuration '%s'", item); }
+  }
+  free(buf);
+}
+
+void init_branch_prof(const char *spec) {
+  if (spec != NULL) { parse_spec(spec); }
+
+  Assert(pred_bits > 0 && pred_bits <= 24, "the predictor must have 1 to 24 index bits");
+  /* weakly not taken */
+  counter = malloc(1u << pred_bits);
+  Assert(counter, "Can not allocate the branch predictor");
+  memset(counter, 1, 1u << pred_bits);
+
+  Assert(btb_ways > 0 && btb_entries % btb_ways == 0, "BTB entries must be a multiple of ways");
+  uint32_t nr_set = btb_entries / btb_ways;
+  Assert(nr_set > 0 && (nr_set & (nr_set - 1)) == 0, "number of BTB sets must be a power of 2");
+  btb_set_mask = nr_set - 1;
+  btb = calloc(btb_entries, sizeof(BTBEntry));
+  Assert(btb, "Can not allocate the BTB");
+
+  resize(INIT_CAP);
+
+  Log("branch predictor: %s with %d bits, BTB of %u entries in %u ways",
+      pred_name[pred], pred_bits, btb_entries, btb_ways);
+}
+
+#define NR_TOP 20
+
+typedef struct {
+  const char *name;
+  uint64_t count, miss;
+} FuncBranch;
+
+static int site_cmp(const void *a, const void *b) {
+  uint64_t ma = (*(Site **)a)->miss, mb = (*(Site **)b)->miss;
+  return (ma < mb) - (ma > mb);
+}
+
+static int func_cmp(const void *a, const void *b) {
+  uint64_t ma = ((FuncBranch *)a)->miss, mb = ((FuncBranch *)b)->miss;
+  return (ma < mb) - (ma > mb);
+}
+
+static inline double percent(uint64_t a, uint64_t b) {
+  return (b == 0 ? 0 : 100.0 * a / b);
+}
+
+void branch_report() {
+  uint64_t count[3] = {0}, taken[3] = {0}, miss[3] = {0};
+  Site **sorted = malloc(sizeof(Site *) * (nr_site + 1));
+  FuncBranch *func = calloc(nr_site + 1, sizeof(FuncBranch));
+  Assert(sorted && func, "Can not allocate the branch report");
+
+  /* group the sites by functions, whose names are compared by pointers */
+  int n = 0, nr_func = 0, i, j;
+  for (i = 0; i < cap; i ++) {
+    Site *s = &site[i];
+    if (s->count == 0) continue;
+    sorted[n ++] = s;
+    count[s->type] += s->count;
+    taken[s->type] += s->taken;
+    miss[s->type] += s->miss;
+
+    const char *name = elf_func_name(s->pc);
+    if (name == NULL) { name = "(unknown)"; }
+    for (j = 0; j < nr_func && func[j].name != name; j ++);
+    if (j == nr_func) { func[nr_func ++].name = name; }
+    func[j].count += s->count;
+    func[j].miss += s->miss;
+  }
+
+  printflog("%-10s %14s %8s %14s %8s\n", "branch", "count", "taken", "mispredicts", "rate");
+  for (i = 0; i < 3; i ++) {
+    printflog("%-10s %14" PRIu64 " %7.2f%% %14" PRIu64 " %7.2f%%\n", type_name[i],
+        count[i], percent(taken[i], count[i]), miss[i], percent(miss[i], count[i]));
+  }
+  printflog("BTB lookups = %" PRIu64 ", misses = %" PRIu64 " (%.2f%%)\n",
+      btb_lookup, btb_miss, percent(btb_miss, btb_lookup));
+
+  if (n == 0) goto out;
+
+  qsort(func, nr_func, sizeof(func[0]), func_cmp);
+  printflog("%-24s %14s %14s %8s\n", "function", "branches", "mispredicts", "rate");
+  for (i = 0; i < nr_func && i < NR_TOP; i ++) {
+    printflog("%-24s %14" PRIu64 " %14" PRIu64 " %7.2f%%\n",
+        func[i].name, func[i].count, func[i].miss, percent(func[i].miss, func[i].count));
+  }
+
+  qsort(sorted, n, sizeof(sorted[0]), site_cmp);
+  printflog("%-10s %-8s %-24s %14s %8s %14s  %s\n", "eip", "type", "function",
+      "count", "taken", "mispredicts", "targets");
+  for (i = 0; i < n && i < NR_TOP; i ++) {
+    Site *s = sorted[i];
+    const char *name = elf_func_name(s->pc);
+    printflog("0x%08x %-8s %-24s %14" PRIu64 " %7.2f%% %14" PRIu64 " ", s->pc, type_name[s->type],
+        (name == NULL ? "(unknown)" : name), s->count, percent(s->taken, s->count), s->miss);
+    if (s->type == BR_INDIRECT) {
+      for (j = 0; j < NR_TARGET && s->target_count[j] != 0; j ++) {
+        printflog(" 0x%08x:%" PRIu64, s->target[j], s->target_count[j]);
+      }
+      if (s->other_target != 0) { printflog(" others:%" PRIu64, s->other_target); }
+    }
+    printflog("\n");
+  }
+
+out:
+  free(sorted);
+  free(func);
+}
+
+#endif
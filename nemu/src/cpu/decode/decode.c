@@ -2,22 +2,25 @@
 #include "cpu/rtl.h"
 
 /* shared by all helper functions */
-DecodeInfo decoding;
-rtlreg_t t0, t1, t2, t3, at;
+NEMU_TLS DecodeInfo decoding;
+NEMU_TLS rtlreg_t t0, t1, t2, t3, at;
 
 void decoding_set_jmp(bool is_jmp) {
   decoding.is_jmp = is_jmp;
 }
 
-#define make_DopHelper(name) void concat(decode_op_, name) (vaddr_t *eip, Operand *op, bool load_val)
+/* Operand helpers are always inlined into the helpers of each width
+ * class, so `width' is a constant there. */
+#define make_DopHelper(name) void concat(decode_op_, name) (vaddr_t *eip, Operand *op, bool load_val, const int width)
 
 /* Refer to Appendix A in i386 manual for the explanations of these abbreviations */
 
 /* Ib, Iv */
-static inline make_DopHelper(I) {
+static inline __attribute__((always_inline)) make_DopHelper(I) {
   /* eip here is pointing to the immediate */
   op->type = OP_TYPE_IMM;
-  op->imm = instr_fetch(eip, op->width);
+  op->width = width;
+  op->imm = instr_fetch(eip, width);
   rtl_li(&op->val, op->imm);
 
 #ifdef DEBUG
@@ -30,12 +33,13 @@ static inline make_DopHelper(I) {
  * function to decode it.
  */
 /* sign immediate */
-static inline make_DopHelper(SI) {
-  assert(op->width == 1 || op->width == 4);
+static inline __attribute__((always_inline)) make_DopHelper(SI) {
+  assert(width == 1 || width == 4);
 
   op->type = OP_TYPE_IMM;
+  op->width = width;
 
-  /* TODO: Use instr_fetch() to read `op->width' bytes of memory
+  /* TODO: Use instr_fetch() to read `width' bytes of memory
    * pointed by `eip'. Interpret the result as a signed immediate,
    * and assign it to op->simm.
    *
@@ -54,15 +58,16 @@ static inline make_DopHelper(SI) {
  * It is convenient to merge them into a single helper function.
  */
 /* AL/eAX */
-static inline make_DopHelper(a) {
+static inline __attribute__((always_inline)) make_DopHelper(a) {
   op->type = OP_TYPE_REG;
   op->reg = R_EAX;
+  op->width = width;
   if (load_val) {
-    rtl_lr(&op->val, R_EAX, op->width);
+    rtl_lr(&op->val, R_EAX, width);
   }
 
 #ifdef DEBUG
-  snprintf(op->str, OP_STR_SIZE, "%%%s", reg_name(R_EAX, op->width));
+  snprintf(op->str, OP_STR_SIZE, "%%%s", reg_name(R_EAX, width));
 #endif
 }
 
@@ -70,15 +75,16 @@ static inline make_DopHelper(a) {
 /* XX: AL, AH, BL, BH, CL, CH, DL, DH
  * eXX: eAX, eCX, eDX, eBX, eSP, eBP, eSI, eDI
  */
-static inline make_DopHelper(r) {
+static inline __attribute__((always_inline)) make_DopHelper(r) {
   op->type = OP_TYPE_REG;
   op->reg = decoding.opcode & 0x7;
+  op->width = width;
   if (load_val) {
-    rtl_lr(&op->val, op->reg, op->width);
+    rtl_lr(&op->val, op->reg, width);
   }
 
 #ifdef DEBUG
-  snprintf(op->str, OP_STR_SIZE, "%%%s", reg_name(op->reg, op->width));
+  snprintf(op->str, OP_STR_SIZE, "%%%s", reg_name(op->reg, width));
 #endif
 }
 
@@ -92,16 +98,29 @@ static inline make_DopHelper(r) {
  * Rd
  * Sw
  */
-static inline void decode_op_rm(vaddr_t *eip, Operand *rm, bool load_rm_val, Operand *reg, bool load_reg_val) {
-  read_ModR_M(eip, rm, load_rm_val, reg, load_reg_val);
+static inline __attribute__((always_inline)) void decode_op_rm(vaddr_t *eip,
+    Operand *rm, bool load_rm_val, Operand *reg, bool load_reg_val, const int width) {
+  rm->width = width;
+  if (reg != NULL) { reg->width = width; }
+  read_ModR_M(eip, rm, false, reg, false);
+
+  /* load the values here, where the width is known at compile time */
+  if (reg != NULL && load_reg_val) {
+    rtl_lr(&reg->val, reg->reg, width);
+  }
+  if (load_rm_val) {
+    if (rm->type == OP_TYPE_REG) { rtl_lr(&rm->val, rm->reg, width); }
+    else { rtl_lm(&rm->val, &rm->addr, width); }
+  }
 }
 
 /* Ob, Ov */
-static inline make_DopHelper(O) {
+static inline __attribute__((always_inline)) make_DopHelper(O) {
   op->type = OP_TYPE_MEM;
+  op->width = width;
   rtl_li(&op->addr, instr_fetch(eip, 4));
   if (load_val) {
-    rtl_lm(&op->val, &op->addr, op->width);
+    rtl_lm(&op->val, &op->addr, width);
   }
 
 #ifdef DEBUG
@@ -112,119 +131,117 @@ static inline make_DopHelper(O) {
 /* Eb <- Gb
  * Ev <- Gv
  */
-make_DHelper(G2E) {
-  decode_op_rm(eip, id_dest, true, id_src, true);
+make_DHelperW(G2E) {
+  decode_op_rm(eip, id_dest, true, id_src, true, width);
 }
 
-make_DHelper(mov_G2E) {
-  decode_op_rm(eip, id_dest, false, id_src, true);
+make_DHelperW(mov_G2E) {
+  decode_op_rm(eip, id_dest, false, id_src, true, width);
 }
 
 /* Gb <- Eb
  * Gv <- Ev
  */
-make_DHelper(E2G) {
-  decode_op_rm(eip, id_src, true, id_dest, true);
+make_DHelperW(E2G) {
+  decode_op_rm(eip, id_src, true, id_dest, true, width);
 }
 
-make_DHelper(mov_E2G) {
-  decode_op_rm(eip, id_src, true, id_dest, false);
+make_DHelperW(mov_E2G) {
+  decode_op_rm(eip, id_src, true, id_dest, false, width);
 }
 
-make_DHelper(lea_M2G) {
-  decode_op_rm(eip, id_src, false, id_dest, false);
+make_DHelperW(lea_M2G) {
+  decode_op_rm(eip, id_src, false, id_dest, false, width);
 }
 
 /* AL <- Ib
  * eAX <- Iv
  */
-make_DHelper(I2a) {
-  decode_op_a(eip, id_dest, true);
-  decode_op_I(eip, id_src, true);
+make_DHelperW(I2a) {
+  decode_op_a(eip, id_dest, true, width);
+  decode_op_I(eip, id_src, true, width);
 }
 
 /* Gv <- EvIb
  * Gv <- EvIv
  * use for imul */
-make_DHelper(I_E2G) {
-  decode_op_rm(eip, id_src2, true, id_dest, false);
-  decode_op_I(eip, id_src, true);
+make_DHelperW(I_E2G) {
+  decode_op_rm(eip, id_src2, true, id_dest, false, width);
+  decode_op_I(eip, id_src, true, width);
 }
 
 /* Eb <- Ib
  * Ev <- Iv
  */
-make_DHelper(I2E) {
-  decode_op_rm(eip, id_dest, true, NULL, false);
-  decode_op_I(eip, id_src, true);
+make_DHelperW(I2E) {
+  decode_op_rm(eip, id_dest, true, NULL, false, width);
+  decode_op_I(eip, id_src, true, width);
 }
 
-make_DHelper(mov_I2E) {
-  decode_op_rm(eip, id_dest, false, NULL, false);
-  decode_op_I(eip, id_src, true);
+make_DHelperW(mov_I2E) {
+  decode_op_rm(eip, id_dest, false, NULL, false, width);
+  decode_op_I(eip, id_src, true, width);
 }
 
 /* XX <- Ib
  * eXX <- Iv
  */
-make_DHelper(I2r) {
-  decode_op_r(eip, id_dest, true);
-  decode_op_I(eip, id_src, true);
+make_DHelperW(I2r) {
+  decode_op_r(eip, id_dest, true, width);
+  decode_op_I(eip, id_src, true, width);
 }
 
-make_DHelper(mov_I2r) {
-  decode_op_r(eip, id_dest, false);
-  decode_op_I(eip, id_src, true);
+make_DHelperW(mov_I2r) {
+  decode_op_r(eip, id_dest, false, width);
+  decode_op_I(eip, id_src, true, width);
 }
 
 /* used by unary operations */
-make_DHelper(I) {
-  decode_op_I(eip, id_dest, true);
+make_DHelperW(I) {
+  decode_op_I(eip, id_dest, true, width);
 }
 
-make_DHelper(r) {
-  decode_op_r(eip, id_dest, true);
+make_DHelperW(r) {
+  decode_op_r(eip, id_dest, true, width);
 }
 
-make_DHelper(E) {
-  decode_op_rm(eip, id_dest, true, NULL, false);
+make_DHelperW(E) {
+  decode_op_rm(eip, id_dest, true, NULL, false, width);
 }
 
-make_DHelper(setcc_E) {
-  decode_op_rm(eip, id_dest, false, NULL, false);
+make_DHelperW(setcc_E) {
+  decode_op_rm(eip, id_dest, false, NULL, false, width);
 }
 
-make_DHelper(gp7_E) {
-  decode_op_rm(eip, id_dest, false, NULL, false);
+make_DHelperW(gp7_E) {
+  decode_op_rm(eip, id_dest, false, NULL, false, width);
 }
 
 /* used by test in group3 */
-make_DHelper(test_I) {
-  decode_op_I(eip, id_src, true);
+make_DHelperW(test_I) {
+  decode_op_I(eip, id_src, true, width);
 }
 
-make_DHelper(SI2E) {
-  assert(id_dest->width == 2 || id_dest->width == 4);
-  decode_op_rm(eip, id_dest, true, NULL, false);
-  id_src->width = 1;
-  decode_op_SI(eip, id_src, true);
-  if (id_dest->width == 2) {
+make_DHelperW(SI2E) {
+  assert(width == 2 || width == 4);
+  decode_op_rm(eip, id_dest, true, NULL, false, width);
+  decode_op_SI(eip, id_src, true, 1);
+  if (width == 2) {
     id_src->val &= 0xffff;
   }
 }
 
-make_DHelper(SI_E2G) {
-  assert(id_dest->width == 2 || id_dest->width == 4);
-  decode_op_rm(eip, id_src2, true, id_dest, false);
-  id_src->width = 1;
-  decode_op_SI(eip, id_src, true);
-  if (id_dest->width == 2) {
+make_DHelperW(SI_E2G) {
+  assert(width == 2 || width == 4);
+  decode_op_rm(eip, id_src2, true, id_dest, false, width);
+  decode_op_SI(eip, id_src, true, 1);
+  if (width == 2) {
     id_src->val &= 0xffff;
   }
 }
 
-make_DHelper(gp2_1_E) {
-  decode_op_rm(eip, id_dest, true, NULL, false);
+make_DHelperW(gp2_1_E) {
+  decode_op_rm(eip, id_dest, true, NULL, false, width);
   id_src->type = OP_TYPE_IMM;
   id_src->imm = 1;
   rtl_li(&id_src->val, 1);
@@ -233,8 +250,8 @@ make_DHelper(gp2_1_E) {
 #endif
 }
 
-make_DHelper(gp2_cl2E) {
-  decode_op_rm(eip, id_dest, true, NULL, false);
+make_DHelperW(gp2_cl2E) {
+  decode_op_rm(eip, id_dest, true, NULL, false, width);
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_CL;
   rtl_lr(&id_src->val, R_CL, 1);
@@ -243,24 +260,22 @@ make_DHelper(gp2_cl2E) {
 #endif
 }
 
-make_DHelper(gp2_Ib2E) {
-  decode_op_rm(eip, id_dest, true, NULL, false);
-  id_src->width = 1;
-  decode_op_I(eip, id_src, true);
+make_DHelperW(gp2_Ib2E) {
+  decode_op_rm(eip, id_dest, true, NULL, false, width);
+  decode_op_I(eip, id_src, true, 1);
 }
 
 /* Ev <- GvIb
  * use for shld/shrd */
-make_DHelper(Ib_G2E) {
-  decode_op_rm(eip, id_dest, true, id_src2, true);
-  id_src->width = 1;
-  decode_op_I(eip, id_src, true);
+make_DHelperW(Ib_G2E) {
+  decode_op_rm(eip, id_dest, true, id_src2, true, width);
+  decode_op_I(eip, id_src, true, 1);
 }
 
 /* Ev <- GvCL
  * use for shld/shrd */
-make_DHelper(cl_G2E) {
-  decode_op_rm(eip, id_dest, true, id_src2, true);
+make_DHelperW(cl_G2E) {
+  decode_op_rm(eip, id_dest, true, id_src2, true, width);
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_CL;
   rtl_lr(&id_src->val, R_CL, 1);
@@ -269,33 +284,32 @@ make_DHelper(cl_G2E) {
 #endif
 }
 
-make_DHelper(O2a) {
-  decode_op_O(eip, id_src, true);
-  decode_op_a(eip, id_dest, false);
+make_DHelperW(O2a) {
+  decode_op_O(eip, id_src, true, width);
+  decode_op_a(eip, id_dest, false, width);
 }
 
-make_DHelper(a2O) {
-  decode_op_a(eip, id_src, true);
-  decode_op_O(eip, id_dest, false);
+make_DHelperW(a2O) {
+  decode_op_a(eip, id_src, true, width);
+  decode_op_O(eip, id_dest, false, width);
 }
 
-make_DHelper(J) {
-  decode_op_SI(eip, id_dest, false);
+make_DHelperW(J) {
+  decode_op_SI(eip, id_dest, false, width);
   // the target address can be computed in the decode stage
   decoding.jmp_eip = id_dest->simm + *eip;
 }
 
-make_DHelper(push_SI) {
-  decode_op_SI(eip, id_dest, true);
+make_DHelperW(push_SI) {
+  decode_op_SI(eip, id_dest, true, width);
 }
 
-make_DHelper(in_I2a) {
-  id_src->width = 1;
-  decode_op_I(eip, id_src, true);
-  decode_op_a(eip, id_dest, false);
+make_DHelperW(in_I2a) {
+  decode_op_I(eip, id_src, true, 1);
+  decode_op_a(eip, id_dest, false, width);
 }
 
-make_DHelper(in_dx2a) {
+make_DHelperW(in_dx2a) {
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_DX;
   rtl_lr(&id_src->val, R_DX, 2);
@@ -303,17 +317,16 @@ make_DHelper(in_dx2a) {
   sprintf(id_src->str, "(%%dx)");
 #endif
 
-  decode_op_a(eip, id_dest, false);
+  decode_op_a(eip, id_dest, false, width);
 }
 
-make_DHelper(out_a2I) {
-  decode_op_a(eip, id_src, true);
-  id_dest->width = 1;
-  decode_op_I(eip, id_dest, true);
+make_DHelperW(out_a2I) {
+  decode_op_a(eip, id_src, true, width);
+  decode_op_I(eip, id_dest, true, 1);
 }
 
-make_DHelper(out_a2dx) {
-  decode_op_a(eip, id_src, true);
+make_DHelperW(out_a2dx) {
+  decode_op_a(eip, id_src, true, width);
 
   id_dest->type = OP_TYPE_REG;
   id_dest->reg = R_DX;
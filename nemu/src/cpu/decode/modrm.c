@@ -1,50 +1,93 @@
 #include "cpu/exec.h"
 #include "cpu/rtl.h"
 
+/* Addressing forms of a memory operand, the displacement is always added */
+enum { EA_DISP, EA_BASE, EA_INDEX, EA_BASE_INDEX };
+#define EA_FORM(base, index) (((base) != -1 ? EA_BASE : 0) | ((index) != -1 ? EA_INDEX : 0))
+
+typedef struct {
+  int8_t base;        // -1 if there is no base register
+  uint8_t disp_size;  // 0, 1 or 4 bytes
+  uint8_t form;
+  bool has_sib;       // base and index come from the SIB byte
+} ModRMInfo;
+
+typedef struct {
+  int8_t base;
+  int8_t index;       // -1 if there is no index register
+  uint8_t scale;
+  uint8_t form;       // assume the base is present
+} SIBInfo;
+
+/* The tables are precomputed at compile time for all 256 values. */
+#define MODRM_MOD(m) ((m) >> 6)
+#define MODRM_RM(m) ((m) & 0x7)
+#define MODRM_HAS_SIB(m) (MODRM_MOD(m) != 3 && MODRM_RM(m) == R_ESP)
+#define MODRM_BASE(m) (MODRM_MOD(m) == 0 && MODRM_RM(m) == R_EBP ? -1 : MODRM_RM(m))
+#define MODRM_DISP_SIZE(m) (MODRM_MOD(m) == 1 ? 1 : \
+    (MODRM_MOD(m) == 2 || (MODRM_MOD(m) == 0 && MODRM_RM(m) == R_EBP) ? 4 : 0))
+#define MODRM_ENTRY(m) \
+  { MODRM_BASE(m), MODRM_DISP_SIZE(m), EA_FORM(MODRM_BASE(m), -1), MODRM_HAS_SIB(m) }
+
+#define SIB_INDEX(s) (((s) >> 3 & 0x7) == R_ESP ? -1 : ((s) >> 3 & 0x7))
+#define SIB_ENTRY(s) \
+  { (s) & 0x7, SIB_INDEX(s), (s) >> 6, EA_FORM(0, SIB_INDEX(s)) }
+
+#define REPEAT4(f, i) f(i), f(i + 1), f(i + 2), f(i + 3)
+#define REPEAT16(f, i) REPEAT4(f, i), REPEAT4(f, i + 4), REPEAT4(f, i + 8), REPEAT4(f, i + 12)
+#define REPEAT64(f, i) REPEAT16(f, i), REPEAT16(f, i + 16), REPEAT16(f, i + 32), REPEAT16(f, i + 48)
+#define REPEAT256(f) REPEAT64(f, 0), REPEAT64(f, 64), REPEAT64(f, 128), REPEAT64(f, 192)
+
+static const ModRMInfo modrm_table[256] = { REPEAT256(MODRM_ENTRY) };
+static const SIBInfo sib_table[256] = { REPEAT256(SIB_ENTRY) };
+
 void load_addr(vaddr_t *eip, ModR_M *m, Operand *rm) {
   assert(m->mod != 3);
 
-  int32_t disp = 0;
-  int disp_size = 4;
-  int base_reg = -1, index_reg = -1, scale = 0;
-  rtl_li(&t0, 0);
-
-  if (m->R_M == R_ESP) {
-    SIB s;
-    s.val = instr_fetch(eip, 1);
-    base_reg = s.base;
-    scale = s.ss;
-
-    if (s.index != R_ESP) { index_reg = s.index; }
-  }
-  else {
-    /* no SIB */
-    base_reg = m->R_M;
-  }
-
-  if (m->mod == 0) {
-    if (base_reg == R_EBP) { base_reg = -1; }
-    else { disp_size = 0; }
+  const ModRMInfo *mi = &modrm_table[m->val];
+  int base_reg = mi->base, index_reg = -1, scale = 0;
+  int disp_size = mi->disp_size;
+  int form = mi->form;
+
+  if (mi->has_sib) {
+    const SIBInfo *si = &sib_table[instr_fetch(eip, 1)];
+    base_reg = si->base;
+    index_reg = si->index;
+    scale = si->scale;
+    form = si->form;
+
+    if (m->mod == 0 && base_reg == R_EBP) {
+      /* no base, but a 32-bit displacement */
+      base_reg = -1;
+      disp_size = 4;
+      form &= ~EA_BASE;
+    }
   }
-  else if (m->mod == 1) { disp_size = 1; }
 
+  int32_t disp = 0;
   if (disp_size != 0) {
     /* has disp */
     disp = instr_fetch(eip, disp_size);
     if (disp_size == 1) { disp = (int8_t)disp; }
-
-    rtl_addi(&t0, &t0, disp);
-  }
-
-  if (base_reg != -1) {
-    rtl_add(&t0, &t0, &reg_l(base_reg));
   }
 
-  if (index_reg != -1) {
-    rtl_shli(&t1, &reg_l(index_reg), scale);
-    rtl_add(&t0, &t0, &t1);
+  switch (form) {
+    case EA_DISP:
+      rtl_li(&rm->addr, disp);
+      break;
+    case EA_BASE:
+      rtl_addi(&rm->addr, &reg_l(base_reg), disp);
+      break;
+    case EA_INDEX:
+      rtl_shli(&t0, &reg_l(index_reg), scale);
+      rtl_addi(&rm->addr, &t0, disp);
+      break;
+    case EA_BASE_INDEX:
+      rtl_shli(&t0, &reg_l(index_reg), scale);
+      rtl_add(&t0, &t0, &reg_l(base_reg));
+      rtl_addi(&rm->addr, &t0, disp);
+      break;
   }
-  rtl_mv(&rm->addr, &t0);
 
 #ifdef DEBUG
   char disp_buf[16];
@@ -1,8 +1,22 @@
 #include "cpu/exec.h"
 
-make_EHelper(mov);
+declare_EHelperW(mov);
 
 make_EHelper(operand_size);
+make_EHelper(rep);
+make_EHelper(repne);
+
+make_EHelper(movs);
+make_EHelper(cmps);
+make_EHelper(stos);
+make_EHelper(lods);
+make_EHelper(scas);
+
+make_EHelper(lidt);
+make_EHelper(iret);
+make_EHelper(cli);
+make_EHelper(sti);
+make_EHelper(popf);
 
 make_EHelper(inv);
 make_EHelper(nemu_trap);
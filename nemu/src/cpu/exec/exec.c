@@ -1,32 +1,128 @@
 #include "cpu/exec.h"
 #include "all-instr.h"
 
+/* Helpers are instantiated for each width class (8, 16 and 32 bits, see
+ * make_DHelperW() and make_EHelperW()), and an entry records which class
+ * to use without and with the operand-size prefix. Helpers in IDEXW() and
+ * IDEX() must be width-specialized, while the ones in EXW() and EX() are
+ * ordinary helpers which read the width from the operands.
+ */
+enum { WIDTH_CLS_B, WIDTH_CLS_W, WIDTH_CLS_L, NR_WIDTH_CLS };
+
 typedef struct {
-  DHelper decode;
-  EHelper execute;
-  int width;
+  DHelper decode[NR_WIDTH_CLS];
+  EHelper execute[NR_WIDTH_CLS];
+  uint8_t cls[2];   // indexed by decoding.is_operand_size_16
+#ifdef OPCODE_PROFILE
+  const char *name;
+#endif
 } opcode_entry;
 
-#define IDEXW(id, ex, w)   {concat(decode_, id), concat(exec_, ex), w}
+#ifdef OPCODE_PROFILE
+#define ENTRY_NAME(ex)     , str(ex)
+#else
+#define ENTRY_NAME(ex)
+#endif
+
+/* width `w' is 0 for the operand size, or a fixed 1, 2, 4 */
+#define WIDTH_CLS(w, is_16) ((w) == 0 ? WIDTH_CLS_L - (is_16) : (w) / 2)
+#define ENTRY_CLS(w)       {WIDTH_CLS(w, 0), WIDTH_CLS(w, 1)}
+#define HELPERW(prefix, name) \
+  {concat3(prefix, name, _b), concat3(prefix, name, _w), concat3(prefix, name, _l)}
+
+#define IDEXW(id, ex, w)   {HELPERW(decode_, id), HELPERW(exec_, ex), ENTRY_CLS(w) ENTRY_NAME(ex)}
 #define IDEX(id, ex)       IDEXW(id, ex, 0)
-#define EXW(ex, w)         {NULL, concat(exec_, ex), w}
+#define EXW(ex, w)         {{NULL, NULL, NULL}, \
+  {concat(exec_, ex), concat(exec_, ex), concat(exec_, ex)}, ENTRY_CLS(w) ENTRY_NAME(ex)}
 #define EX(ex)             EXW(ex, 0)
 #define EMPTY              EX(inv)
 
-static inline void set_width(int width) {
-  if (width == 0) {
-    width = decoding.is_operand_size_16 ? 2 : 4;
-  }
+static inline void set_width(int cls) {
+  int width = 1 << cls;
   decoding.src.width = decoding.dest.width = decoding.src2.width = width;
 }
 
 /* Instruction Decode and EXecute */
-static inline void idex(vaddr_t *eip, opcode_entry *e) {
+static inline void idex_real(vaddr_t *eip, opcode_entry *e, int cls) {
   /* eip is pointing to the byte next to opcode */
-  if (e->decode)
-    e->decode(eip);
-  e->execute(eip);
+  if (e->decode[cls])
+    e->decode[cls](eip);
+  e->execute[cls](eip);
+}
+
+#ifdef OPCODE_PROFILE
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* Dynamic count and host cycles of each entry. The second index is 0 for
+ * the entry in opcode_table, and 1 + ext_opcode for the entries of the
+ * group tables. Cycles are exclusive: the cycles spent in a nested idex()
+ * (prefixes, groups) are only charged to the nested entry.
+ */
+typedef struct {
+  uint64_t count;
+  uint64_t cycles;
+  const char *name;
+} opcode_prof;
+
+extern opcode_entry opcode_table [512];
+static opcode_prof prof[512][9];
+static uint64_t prof_child_cycles = 0;
+
+static inline void idex(vaddr_t *eip, opcode_entry *e, int cls) {
+  bool is_group = !(e >= opcode_table && e < opcode_table + 512);
+  opcode_prof *p = &prof[decoding.opcode][is_group ? decoding.ext_opcode + 1 : 0];
+  uint64_t saved_child_cycles = prof_child_cycles;
+  prof_child_cycles = 0;
+
+  uint64_t start = __builtin_ia32_rdtsc();
+  idex_real(eip, e, cls);
+  uint64_t cycles = __builtin_ia32_rdtsc() - start;
+
+  p->count ++;
+  p->cycles += cycles - prof_child_cycles;
+  p->name = e->name;
+  prof_child_cycles = saved_child_cycles + cycles;
+}
+
+static int prof_cmp(const void *a, const void *b) {
+  uint64_t ca = (*(opcode_prof **)a)->count, cb = (*(opcode_prof **)b)->count;
+  return (ca < cb) - (ca > cb);
+}
+
+void opcode_profile_report() {
+  static opcode_prof *sorted[512 * 9];
+  opcode_prof *base = &prof[0][0];
+  uint64_t total_count = 0, total_cycles = 0;
+  int i, n = 0;
+  for (i = 0; i < 512 * 9; i ++) {
+    if (base[i].count != 0) {
+      sorted[n ++] = &base[i];
+      total_count += base[i].count;
+      total_cycles += base[i].cycles;
+    }
+  }
+  qsort(sorted, n, sizeof(sorted[0]), prof_cmp);
+
+  printflog("%-10s %-16s %14s %7s %16s %7s %10s\n", "opcode", "helper",
+      "count", "", "cycles", "", "cycles/op");
+  for (i = 0; i < n; i ++) {
+    opcode_prof *p = sorted[i];
+    int opcode = (p - base) / 9, sub = (p - base) % 9;
+    char buf[16];
+    int len = sprintf(buf, "%s%02x", (opcode & 0x100 ? "0f " : ""), opcode & 0xff);
+    if (sub != 0) { sprintf(buf + len, "/%d", sub - 1); }
+
+    printflog("%-10s %-16s %14" PRIu64 " %6.2f%% %16" PRIu64 " %6.2f%% %10.1f\n",
+        buf, p->name, p->count, 100.0 * p->count / total_count,
+        p->cycles, 100.0 * p->cycles / total_cycles, (double)p->cycles / p->count);
+  }
+}
+#else
+static inline void idex(vaddr_t *eip, opcode_entry *e, int cls) {
+  idex_real(eip, e, cls);
 }
+#endif
 
 static make_EHelper(2byte_esc);
 
@@ -35,8 +131,14 @@ static make_EHelper(2byte_esc);
     /* 0x00 */	item0, item1, item2, item3, \
     /* 0x04 */	item4, item5, item6, item7  \
   }; \
-static make_EHelper(name) { \
-  idex(eip, &concat(opcode_table_, name)[decoding.ext_opcode]); \
+static make_EHelper(concat(name, _b)) { \
+  idex(eip, &concat(opcode_table_, name)[decoding.ext_opcode], WIDTH_CLS_B); \
+} \
+static make_EHelper(concat(name, _w)) { \
+  idex(eip, &concat(opcode_table_, name)[decoding.ext_opcode], WIDTH_CLS_W); \
+} \
+static make_EHelper(concat(name, _l)) { \
+  idex(eip, &concat(opcode_table_, name)[decoding.ext_opcode], WIDTH_CLS_L); \
 }
 
 /* 0x80, 0x81, 0x83 */
@@ -66,7 +168,7 @@ make_group(gp5,
 
   /* 0x0f 0x01*/
 make_group(gp7,
-    EMPTY, EMPTY, EMPTY, EMPTY,
+    EMPTY, EMPTY, EMPTY, EX(lidt),
     EMPTY, EMPTY, EMPTY, EMPTY)
 
 /* TODO: Add more instructions!!! */
@@ -111,11 +213,11 @@ opcode_entry opcode_table [512] = {
   /* 0x90 */	EMPTY, EMPTY, EMPTY, EMPTY,
   /* 0x94 */	EMPTY, EMPTY, EMPTY, EMPTY,
   /* 0x98 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0x9c */	EMPTY, EMPTY, EMPTY, EMPTY,
+  /* 0x9c */	EMPTY, EX(popf), EMPTY, EMPTY,
   /* 0xa0 */	IDEXW(O2a, mov, 1), IDEX(O2a, mov), IDEXW(a2O, mov, 1), IDEX(a2O, mov),
-  /* 0xa4 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xa8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xac */	EMPTY, EMPTY, EMPTY, EMPTY,
+  /* 0xa4 */	EXW(movs, 1), EX(movs), EXW(cmps, 1), EX(cmps),
+  /* 0xa8 */	EMPTY, EMPTY, EXW(stos, 1), EX(stos),
+  /* 0xac */	EXW(lods, 1), EX(lods), EXW(scas, 1), EX(scas),
   /* 0xb0 */	IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1),
   /* 0xb4 */	IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1), IDEXW(mov_I2r, mov, 1),
   /* 0xb8 */	IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov), IDEX(mov_I2r, mov),
@@ -123,7 +225,7 @@ opcode_entry opcode_table [512] = {
   /* 0xc0 */	IDEXW(gp2_Ib2E, gp2, 1), IDEX(gp2_Ib2E, gp2), EMPTY, EMPTY,
   /* 0xc4 */	EMPTY, EMPTY, IDEXW(mov_I2E, mov, 1), IDEX(mov_I2E, mov),
   /* 0xc8 */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xcc */	EMPTY, EMPTY, EMPTY, EMPTY,
+  /* 0xcc */	EMPTY, EMPTY, EMPTY, EX(iret),
   /* 0xd0 */	IDEXW(gp2_1_E, gp2, 1), IDEX(gp2_1_E, gp2), IDEXW(gp2_cl2E, gp2, 1), IDEX(gp2_cl2E, gp2),
   /* 0xd4 */	EMPTY, EMPTY, EX(nemu_trap), EMPTY,
   /* 0xd8 */	EMPTY, EMPTY, EMPTY, EMPTY,
@@ -132,9 +234,9 @@ opcode_entry opcode_table [512] = {
   /* 0xe4 */	EMPTY, EMPTY, EMPTY, EMPTY,
   /* 0xe8 */	EMPTY, EMPTY, EMPTY, EMPTY,
   /* 0xec */	EMPTY, EMPTY, EMPTY, EMPTY,
-  /* 0xf0 */	EMPTY, EMPTY, EMPTY, EMPTY,
+  /* 0xf0 */	EMPTY, EMPTY, EX(repne), EX(rep),
   /* 0xf4 */	EMPTY, EMPTY, IDEXW(E, gp3, 1), IDEX(E, gp3),
-  /* 0xf8 */	EMPTY, EMPTY, EMPTY, EMPTY,
+  /* 0xf8 */	EMPTY, EMPTY, EX(cli), EX(sti),
   /* 0xfc */	EMPTY, EMPTY, IDEXW(E, gp4, 1), IDEX(E, gp5),
 
   /*2 byte_opcode_table */
@@ -208,22 +310,36 @@ opcode_entry opcode_table [512] = {
 static make_EHelper(2byte_esc) {
   uint32_t opcode = instr_fetch(eip, 1) | 0x100;
   decoding.opcode = opcode;
-  set_width(opcode_table[opcode].width);
-  idex(eip, &opcode_table[opcode]);
+  int cls = opcode_table[opcode].cls[decoding.is_operand_size_16];
+  set_width(cls);
+  idex(eip, &opcode_table[opcode], cls);
 }
 
 make_EHelper(real) {
   uint32_t opcode = instr_fetch(eip, 1);
   decoding.opcode = opcode;
-  set_width(opcode_table[opcode].width);
-  idex(eip, &opcode_table[opcode]);
+  int cls = opcode_table[opcode].cls[decoding.is_operand_size_16];
+  set_width(cls);
+  idex(eip, &opcode_table[opcode], cls);
 }
 
+NEMU_TLS bool at_block_end = false;
+
 static inline void update_eip(void) {
   if (decoding.is_jmp) { decoding.is_jmp = 0; }
   else { cpu.eip = decoding.seq_eip; }
 }
 
+/* Between two blocks, or after eflags.IF may have been set, and after
+ * difftest has checked the last instruction. */
+static inline void end_block(void) {
+  bool is_branch = at_block_end;
+  at_block_end = intr_recheck = false;
+  /* both the target and the fall-through of a branch start a block, and
+   * so does the handler of an interrupt just taken */
+  if (intr_check() || is_branch) { cov_block(cpu.eip); }
+}
+
 void exec_wrapper(bool print_flag) {
   vaddr_t ori_eip = cpu.eip;
 
@@ -251,4 +367,6 @@ void exec_wrapper(bool print_flag) {
   void difftest_step(uint32_t);
   difftest_step(ori_eip);
 #endif
+
+  if (at_block_end || intr_recheck) { end_block(); }
 }
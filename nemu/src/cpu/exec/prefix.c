@@ -7,3 +7,17 @@ make_EHelper(operand_size) {
   exec_real(eip);
   decoding.is_operand_size_16 = false;
 }
+
+/* 0xf3 is rep for movs/stos/lods and repe for cmps/scas,
+ * it is ignored by other instructions */
+make_EHelper(rep) {
+  decoding.rep_prefix = PREFIX_REP;
+  exec_real(eip);
+  decoding.rep_prefix = PREFIX_NONE;
+}
+
+make_EHelper(repne) {
+  decoding.rep_prefix = PREFIX_REPNE;
+  exec_real(eip);
+  decoding.rep_prefix = PREFIX_NONE;
+}
@@ -0,0 +1,263 @@
+#include "cpu/exec.h"
+#include "device/mmio.h"
+#include "memory/mmu.h"
+
+/* String instructions are executed run by run. A run is a sequence of
+ * iterations whose memory operands stay in one page of the physical
+ * memory and do not touch MMIO, and it is done with host memory
+ * operations. Otherwise only one iteration is performed through
+ * vaddr_read()/vaddr_write(). If the instruction is repeated and not
+ * finished yet, eip is left unchanged so that the instruction is
+ * executed again, and interrupts can be taken between runs.
+ *
+ * Under difftest a run is a single iteration, since the reference (QEMU,
+ * or NEMU itself, see string_single_iter) executes one iteration per
+ * step.
+ *
+ * Note that eflags.DF is not modeled yet, all strings go forward.
+ */
+
+NEMU_TLS bool string_single_iter = false;
+
+/* The number of iterations (at most `n') starting from `addr' which can
+ * be done with host memory operations, which start at `*host'. */
+static inline uint32_t host_run(vaddr_t addr, uint32_t n, int width, uint8_t **host) {
+  uint32_t page_left = (PAGE_SIZE - (addr & PAGE_MASK)) / width;
+  if (n > page_left) { n = page_left; }
+  if (string_single_iter && n > 1) { n = 1; }
+  if (n == 0) return 0;
+
+  /* the run stays in one page, so it is contiguous in the physical memory */
+  paddr_t paddr = page_translate(addr);
+  uint32_t len = n * width;
+  if ((uint64_t)paddr + len > pmem_size || is_mmio_range(paddr, len)) return 0;
+  *host = guest_to_host(paddr);
+  return n;
+}
+
+static inline uint32_t rep_count() {
+  return (decoding.rep_prefix == PREFIX_NONE ? 1 : cpu.ecx);
+}
+
+/* `n' iterations are performed, and `stop' is set when the
+ * condition of repe/repne terminates the instruction */
+static inline void rep_done(uint32_t n, bool stop) {
+  if (decoding.rep_prefix == PREFIX_NONE) return;
+  cpu.ecx -= n;
+  if (cpu.ecx != 0 && !stop) {
+    /* execute this instruction again */
+    decoding_set_jmp(true);
+  }
+}
+
+static inline uint32_t host_load(const void *p, int width) {
+  switch (width) {
+    case 4: return *(uint32_t *)p;
+    case 1: return *(uint8_t *)p;
+    case 2: return *(uint16_t *)p;
+    default: assert(0);
+  }
+}
+
+/* eflags <- flags of (dest - src) */
+static inline void cmp_flags(const rtlreg_t *dest, const rtlreg_t *src, int width) {
+  rtl_sub(&t2, dest, src);
+  rtl_update_ZFSF(&t2, width);
+
+  rtl_setrelop(RELOP_LTU, &t0, dest, src);
+  rtl_set_CF(&t0);
+
+  rtl_xor(&t0, dest, src);
+  rtl_xor(&t1, dest, &t2);
+  rtl_and(&t0, &t0, &t1);
+  rtl_msb(&t0, &t0, width);
+  rtl_set_OF(&t0);
+}
+
+static inline const char *rep_name() {
+  switch (decoding.rep_prefix) {
+    case PREFIX_REP: return "rep ";
+    case PREFIX_REPNE: return "repne ";
+    default: return "";
+  }
+}
+
+make_EHelper(movs) {
+  int width = id_dest->width;
+  uint32_t n = rep_count(), run = 0;
+
+  if (n != 0) {
+    uint8_t *src = NULL, *dst = NULL;
+    run = host_run(cpu.esi, n, width, &src);
+    run = host_run(cpu.edi, run, width, &dst);
+    if (run != 0) {
+      uint32_t len = run * width;
+      if (dst > src && dst < src + len) {
+        /* the guest sees the bytes it has just written */
+        uint32_t i;
+        for (i = 0; i < len; i += width) {
+          uint32_t data = host_load(src + i, width);
+          memcpy(dst + i, &data, width);
+        }
+      }
+      else {
+        memmove(dst, src, len);
+      }
+      perfcnt.load += run;
+      perfcnt.store += run;
+      cache_sim_run(cpu.esi, run, width, CACHE_LOAD);
+      mem_trace(TRACE_RUN_LOAD, cpu.esi, width, run);
+      cache_sim_run(cpu.edi, run, width, CACHE_STORE);
+      mem_trace(TRACE_RUN_STORE, cpu.edi, width, run);
+      idt_watch(cpu.edi, run * width);
+    }
+    else {
+      run = 1;
+      rtl_lm(&t0, &cpu.esi, width);
+      rtl_sm(&cpu.edi, &t0, width);
+    }
+    cpu.esi += run * width;
+    cpu.edi += run * width;
+  }
+  rep_done(run, false);
+
+  print_asm("%smovs%c", rep_name(), suffix_char(width));
+}
+
+make_EHelper(stos) {
+  int width = id_dest->width;
+  uint32_t n = rep_count(), run = 0;
+
+  if (n != 0) {
+    rtl_lr(&t1, R_EAX, width);
+    uint8_t *dst = NULL;
+    run = host_run(cpu.edi, n, width, &dst);
+    if (run != 0) {
+      if (width == 1) {
+        memset(dst, t1, run);
+      }
+      else {
+        uint32_t i;
+        for (i = 0; i < run; i ++) {
+          memcpy(dst + i * width, &t1, width);
+        }
+      }
+      perfcnt.store += run;
+      cache_sim_run(cpu.edi, run, width, CACHE_STORE);
+      mem_trace(TRACE_RUN_STORE, cpu.edi, width, run);
+      idt_watch(cpu.edi, run * width);
+    }
+    else {
+      run = 1;
+      rtl_sm(&cpu.edi, &t1, width);
+    }
+    cpu.edi += run * width;
+  }
+  rep_done(run, false);
+
+  print_asm("%sstos%c", rep_name(), suffix_char(width));
+}
+
+make_EHelper(lods) {
+  int width = id_dest->width;
+  uint32_t n = rep_count(), run = 0;
+
+  if (n != 0) {
+    uint8_t *src = NULL;
+    run = host_run(cpu.esi, n, width, &src);
+    if (run != 0) {
+      /* only the last element is visible */
+      t0 = host_load(src + (run - 1) * width, width);
+      perfcnt.load += run;
+      cache_sim_run(cpu.esi, run, width, CACHE_LOAD);
+      mem_trace(TRACE_RUN_LOAD, cpu.esi, width, run);
+    }
+    else {
+      run = 1;
+      rtl_lm(&t0, &cpu.esi, width);
+    }
+    rtl_sr(R_EAX, &t0, width);
+    cpu.esi += run * width;
+  }
+  rep_done(run, false);
+
+  print_asm("%slods%c", rep_name(), suffix_char(width));
+}
+
+/* Compare the element pairs of a run until the condition of repe/repne
+ * fails. Return the number of iterations performed, and the last pair
+ * compared in `dest' and `src'. */
+static inline uint32_t cmp_run(const uint8_t *p_dest, int dest_stride,
+    const uint8_t *p_src, int src_stride, uint32_t run, int width,
+    rtlreg_t *dest, rtlreg_t *src) {
+  uint32_t i;
+  for (i = 0; i < run; i ++) {
+    *dest = host_load(p_dest + i * dest_stride, width);
+    *src = host_load(p_src + i * src_stride, width);
+    bool eq = (*dest == *src);
+    if (eq != (decoding.rep_prefix == PREFIX_REP)) { return i + 1; }
+  }
+  return run;
+}
+
+make_EHelper(cmps) {
+  int width = id_dest->width;
+  uint32_t n = rep_count(), run = 0;
+
+  if (n != 0) {
+    uint8_t *src = NULL, *dst = NULL;
+    run = host_run(cpu.esi, n, width, &src);
+    run = host_run(cpu.edi, run, width, &dst);
+    if (run != 0) {
+      run = cmp_run(src, width, dst, width,
+          run, width, &id_dest->val, &id_src->val);
+      perfcnt.load += run * 2;
+      cache_sim_run(cpu.esi, run, width, CACHE_LOAD);
+      mem_trace(TRACE_RUN_LOAD, cpu.esi, width, run);
+      cache_sim_run(cpu.edi, run, width, CACHE_LOAD);
+      mem_trace(TRACE_RUN_LOAD, cpu.edi, width, run);
+    }
+    else {
+      run = 1;
+      rtl_lm(&id_dest->val, &cpu.esi, width);
+      rtl_lm(&id_src->val, &cpu.edi, width);
+    }
+    cmp_flags(&id_dest->val, &id_src->val, width);
+    cpu.esi += run * width;
+    cpu.edi += run * width;
+  }
+  bool eq = (id_dest->val == id_src->val);
+  rep_done(run, n != 0 && eq != (decoding.rep_prefix == PREFIX_REP));
+
+  print_asm("%scmps%c", rep_name(), suffix_char(width));
+}
+
+make_EHelper(scas) {
+  int width = id_dest->width;
+  uint32_t n = rep_count(), run = 0;
+
+  if (n != 0) {
+    rtl_lr(&id_dest->val, R_EAX, width);
+    uint8_t *dst = NULL;
+    run = host_run(cpu.edi, n, width, &dst);
+    if (run != 0) {
+      /* the accumulator is compared with every element */
+      rtlreg_t acc = id_dest->val;
+      run = cmp_run((void *)&acc, 0, dst, width,
+          run, width, &id_dest->val, &id_src->val);
+      perfcnt.load += run;
+      cache_sim_run(cpu.edi, run, width, CACHE_LOAD);
+      mem_trace(TRACE_RUN_LOAD, cpu.edi, width, run);
+    }
+    else {
+      run = 1;
+      rtl_lm(&id_src->val, &cpu.edi, width);
+    }
+    cmp_flags(&id_dest->val, &id_src->val, width);
+    cpu.edi += run * width;
+  }
+  bool eq = (id_dest->val == id_src->val);
+  rep_done(run, n != 0 && eq != (decoding.rep_prefix == PREFIX_REP));
+
+  print_asm("%sscas%c", rep_name(), suffix_char(width));
+}
@@ -4,7 +4,13 @@ void difftest_skip_ref();
 void difftest_skip_dut();
 
 make_EHelper(lidt) {
-  TODO();
+  rtl_lm(&t0, &id_dest->addr, 2);
+  cpu.idtr.limit = t0;
+  rtl_addi(&t1, &id_dest->addr, 2);
+  rtl_lm(&t0, &t1, 4);
+  /* the base is 24 bits with the operand-size prefix */
+  cpu.idtr.base = (decoding.is_operand_size_16 ? t0 & 0xffffff : t0);
+  intr_idt_flush();
 
   print_asm_template1(lidt);
 }
@@ -36,11 +42,35 @@ make_EHelper(int) {
 }
 
 make_EHelper(iret) {
-  TODO();
+  rtl_pop(&t0);
+  rtl_pop(&cpu.cs);
+  rtl_pop(&cpu.eflags.val);
+  /* also checks the IRQs pending while eflags.IF was cleared */
+  rtl_jr(&t0);
 
   print_asm("iret");
 }
 
+make_EHelper(cli) {
+  cpu.eflags.IF = 0;
+
+  print_asm("cli");
+}
+
+make_EHelper(sti) {
+  cpu.eflags.IF = 1;
+  intr_recheck = true;
+
+  print_asm("sti");
+}
+
+make_EHelper(popf) {
+  rtl_pop(&cpu.eflags.val);
+  intr_recheck = true;
+
+  print_asm("popf");
+}
+
 make_EHelper(in) {
   TODO();
 
@@ -1,13 +1,132 @@
 #include "cpu/exec.h"
 #include "memory/mmu.h"
+#include "cpu/perfcnt.h"
+#include "cpu/intr.h"
+#include "monitor/monitor.h"
+#include <inttypes.h>
+
+void difftest_dut_write(paddr_t addr, uint32_t len);
+void difftest_dut_regs();
+
+NEMU_TLS uint32_t intr_pending = 0;
+NEMU_TLS bool intr_recheck = false;
+
+typedef struct {
+  uint64_t raised, merged, taken;
+  uint64_t latency, max_latency;   // in guest instructions
+} IRQStat;
+
+static const char *irq_name[NR_IRQ] = { "timer" };
+static NEMU_TLS IRQStat irq_stat[NR_IRQ];
+/* the number of guest instructions when each line became pending */
+static NEMU_TLS uint64_t raised_at[NR_IRQ];
+/* the checks which found IRQs pending but eflags.IF cleared */
+static NEMU_TLS uint64_t nr_masked;
+
+/* target of each vector, see idt_lookup() */
+static NEMU_TLS vaddr_t vec_target[256];
+static NEMU_TLS bool vec_valid[256];
+static NEMU_TLS uint64_t nr_idt_flush;
+NEMU_TLS vaddr_t idt_watch_lo = 0, idt_watch_hi = 0;
+
+void intr_idt_flush() {
+  memset(vec_valid, 0, sizeof(vec_valid));
+  idt_watch_lo = idt_watch_hi = 0;
+  nr_idt_flush ++;
+}
+
+static vaddr_t idt_lookup(uint8_t NO) {
+  if (vec_valid[NO]) return vec_target[NO];
+
+  Assert(NO * 8 + 7 <= cpu.idtr.limit, "vector %d is out of the IDT", NO);
+  GateDesc gate;
+  uint32_t *p = (void *)&gate;
+  p[0] = vaddr_read(cpu.idtr.base + NO * 8, 4);
+  p[1] = vaddr_read(cpu.idtr.base + NO * 8 + 4, 4);
+  Assert(gate.present, "the gate of vector %d is not present", NO);
+
+  vec_target[NO] = gate.offset_15_0 | (gate.offset_31_16 << 16);
+  vec_valid[NO] = true;
+  idt_watch_lo = cpu.idtr.base;
+  idt_watch_hi = cpu.idtr.base + cpu.idtr.limit + 1;
+  return vec_target[NO];
+}
+
+static void intr_enter(uint8_t NO, vaddr_t ret_addr) {
+  vaddr_t target = idt_lookup(NO);
+  rtl_push(&cpu.eflags.val);
+  cpu.eflags.IF = 0;
+  rtl_push(&cpu.cs);
+  rtl_push(&ret_addr);
+  cpu.eip = target;
+
+  perfcnt.intr ++;
+}
 
 void raise_intr(uint8_t NO, vaddr_t ret_addr) {
-  /* TODO: Trigger an interrupt/exception with ``NO''.
-   * That is, use ``NO'' to index the IDT.
-   */
+  /* Trigger an interrupt/exception with ``NO'' from an instruction, which
+   * jumps to the handler when it finishes. */
+  intr_enter(NO, ret_addr);
+  decoding_set_jmp(true);
+  at_block_end = true;
+}
 
-  TODO();
+void dev_raise_irq(int irq) {
+  uint32_t bit = 1u << irq;
+  if (intr_pending & bit) {
+    irq_stat[irq].merged ++;
+    return;
+  }
+  intr_pending |= bit;
+  raised_at[irq] = get_nr_guest_instr();
+  irq_stat[irq].raised ++;
 }
 
-void dev_raise_intr() {
+/* Take the pending IRQ of the lowest line, and enter its handler. */
+bool intr_take() {
+  if (!cpu.eflags.IF) {
+    nr_masked ++;
+    return false;
+  }
+
+  int irq = __builtin_ctz(intr_pending);
+  uint64_t latency = get_nr_guest_instr() - raised_at[irq];
+  intr_pending &= ~(1u << irq);
+
+  IRQStat *s = &irq_stat[irq];
+  s->taken ++;
+  s->latency += latency;
+  if (latency > s->max_latency) { s->max_latency = latency; }
+
+  intr_enter(IRQ_BASE + irq, cpu.eip);
+
+#if defined(DIFF_TEST)
+  /* the reference knows nothing about the interrupt, so copy the frame
+   * (word by word, since it may cross a page) and the registers to it */
+  int i;
+  for (i = 0; i < 3; i ++) {
+    difftest_dut_write(page_translate(cpu.esp + i * 4), 4);
+  }
+  difftest_dut_regs();
+#endif
+  return true;
+}
+
+void intr_report() {
+  int i;
+  bool any = false;
+  for (i = 0; i < NR_IRQ; i ++) { any |= (irq_stat[i].raised != 0); }
+  if (!any) return;
+
+  printflog("%-10s %14s %14s %14s %12s %12s\n", "irq", "raised", "merged", "taken",
+      "avg latency", "max latency");
+  for (i = 0; i < NR_IRQ; i ++) {
+    IRQStat *s = &irq_stat[i];
+    if (s->raised == 0) continue;
+    printflog("%-10s %14" PRIu64 " %14" PRIu64 " %14" PRIu64 " %12.1f %12" PRIu64 "\n",
+        irq_name[i], s->raised, s->merged, s->taken,
+        (double)s->latency / (s->taken ? s->taken : 1), s->max_latency);
+  }
+  printflog("checks masked by eflags.IF = %" PRIu64 ", IDT cache flushes = %" PRIu64 "\n",
+      nr_masked, nr_idt_flush);
 }
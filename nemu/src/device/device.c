@@ -2,6 +2,10 @@
 
 #ifdef HAS_IOE
 
+#include "device/replay.h"
+#include "device/timer.h"
+#include "monitor/monitor.h"
+
 #include <sys/time.h>
 #include <signal.h>
 #include <SDL2/SDL.h>
@@ -11,20 +15,28 @@
 
 static uint64_t jiffy = 0;
 static struct itimerval it;
+static uint64_t vclock_next_tick = 0;
+static uint64_t vclock_tick_period = 0;
 static int device_update_flag = false;
 static int update_screen_flag = false;
+/* set by the signal handler, and the tick is taken in device_update(),
+ * between two instructions */
+static volatile sig_atomic_t timer_fired = 0;
 
 void init_serial();
+void serial_flush();
 void init_timer();
 void init_vga();
 void init_i8042();
+void init_perfcnt();
+void init_memsize();
 
 extern void timer_intr();
 extern void send_key(uint8_t, bool);
 extern void update_screen();
 
 
-static void timer_sig_handler(int signum) {
+static void timer_tick() {
   jiffy ++;
   timer_intr();
 
@@ -32,17 +44,39 @@ static void timer_sig_handler(int signum) {
   if (jiffy % (TIMER_HZ / VGA_HZ) == 0) {
     update_screen_flag = true;
   }
+}
+
+static void timer_sig_handler(int signum) {
+  timer_fired = 1;
 
   int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
   Assert(ret == 0, "Can not set timer");
 }
 
 void device_update() {
+  if (replay_mode() == REPLAY_PLAY) {
+    /* all inputs come from the journal, SDL is not touched */
+    replay_update();
+    return;
+  }
+
+  if (vclock_tick_period != 0 && get_nr_guest_instr() >= vclock_next_tick) {
+    vclock_next_tick += vclock_tick_period;
+    timer_tick();
+  }
+
+  if (timer_fired) {
+    timer_fired = 0;
+    timer_tick();
+  }
+
   if (!device_update_flag) {
     return;
   }
   device_update_flag = false;
 
+  serial_flush();
+
   if (update_screen_flag) {
     update_screen();
     update_screen_flag = false;
@@ -73,6 +107,8 @@ void device_update() {
 }
 
 void sdl_clear_event_queue() {
+  if (replay_mode() == REPLAY_PLAY) return;
+
   SDL_Event event;
   while (SDL_PollEvent(&event));
 }
@@ -82,6 +118,20 @@ void init_device() {
   init_timer();
   init_vga();
   init_i8042();
+  init_perfcnt();
+  init_memsize();
+
+  if (replay_mode() == REPLAY_PLAY) {
+    /* timer interrupts come from the journal */
+    return;
+  }
+
+  if (vclock_enabled()) {
+    /* no host timer signal, the timer ticks by guest instructions */
+    vclock_tick_period = vclock_instr_per_sec() / TIMER_HZ;
+    vclock_next_tick = get_nr_guest_instr() + vclock_tick_period;
+    return;
+  }
 
   struct sigaction s;
   memset(&s, 0, sizeof(s));
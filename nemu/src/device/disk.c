@@ -0,0 +1,84 @@
+#include "nemu.h"
+#include "device/port-io.h"
+#include "cpu/intr.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+void difftest_dut_write(paddr_t addr, uint32_t len);
+
+/* A paravirtual block device backed by a host file. The guest describes
+ * a transfer of several sectors with the registers below, and the data
+ * is moved between the file and the guest memory by one memcpy() when
+ * the command register is written.
+ */
+
+#define DISK_PORT 0x300 // Note that this is not the standard
+#define SECTOR_SIZE 512
+
+enum {
+  DISK_NSECT_TOTAL,   // number of sectors of the disk, read only
+  DISK_SECT,          // first sector of the transfer
+  DISK_NSECT,         // number of sectors of the transfer
+  DISK_ADDR,          // guest physical address of the buffer
+  DISK_CMD,           // write to start the transfer
+  DISK_STATUS,        // 0 if the last transfer succeeded
+  NR_DISK_REG
+};
+
+enum { DISK_CMD_READ = 1, DISK_CMD_WRITE = 2 };
+
+static uint32_t *disk_base;
+static uint8_t *disk;
+static uint32_t disk_nsect;
+
+static void disk_io_handler(ioaddr_t addr, int len, bool is_write) {
+  if (!is_write || addr != DISK_PORT + DISK_CMD * 4) return;
+
+  uint64_t sect = disk_base[DISK_SECT];
+  uint64_t nsect = disk_base[DISK_NSECT];
+  uint64_t paddr = disk_base[DISK_ADDR];
+  uint64_t size = nsect * SECTOR_SIZE;
+
+  if (sect + nsect > disk_nsect || paddr + size > pmem_size) {
+    disk_base[DISK_STATUS] = 1;
+    return;
+  }
+
+  switch (disk_base[DISK_CMD]) {
+    case DISK_CMD_READ:
+      memcpy(guest_to_host(paddr), disk + sect * SECTOR_SIZE, size);
+      idt_watch(paddr, size);
+#if defined(DIFF_TEST)
+      difftest_dut_write(paddr, size);
+#endif
+      break;
+    case DISK_CMD_WRITE: memcpy(disk + sect * SECTOR_SIZE, guest_to_host(paddr), size); break;
+    default: disk_base[DISK_STATUS] = 1; return;
+  }
+  disk_base[DISK_STATUS] = 0;
+}
+
+void init_disk(const char *img) {
+  if (img == NULL) return;
+
+  int fd = open(img, O_RDONLY);
+  Assert(fd >= 0, "Can not open '%s'", img);
+  struct stat st;
+  int ret = fstat(fd, &st);
+  assert(ret == 0);
+
+  disk_nsect = (st.st_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+  Assert(disk_nsect > 0, "disk image '%s' is empty", img);
+
+  /* Writes from the guest go to private copies of the pages,
+   * the image file itself is never modified. */
+  disk = mmap(NULL, disk_nsect * SECTOR_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  Assert(disk != MAP_FAILED, "Can not map '%s'", img);
+  close(fd);
+
+  disk_base = add_pio_map(DISK_PORT, NR_DISK_REG * 4, disk_io_handler);
+  disk_base[DISK_NSECT_TOTAL] = disk_nsect;
+  Log("Disk: %s, %d sectors", img, disk_nsect);
+}
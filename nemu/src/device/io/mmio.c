@@ -1,8 +1,9 @@
 #include "common.h"
 #include "device/mmio.h"
+#include "memory/trace.h"
 
-#define MMIO_SPACE_MAX (512 * 1024)
-#define NR_MAP 2
+#define MMIO_SPACE_MAX (1024 * 1024)
+#define NR_MAP 4
 
 static uint8_t mmio_space_pool[MMIO_SPACE_MAX];
 static uint32_t mmio_space_free_index = 0;
@@ -43,6 +44,17 @@ int is_mmio(paddr_t addr) {
   return -1;
 }
 
+/* whether [addr, addr + len) overlaps with any MMIO map */
+bool is_mmio_range(paddr_t addr, uint32_t len) {
+  int i;
+  for (i = 0; i < nr_map; i ++) {
+    if (addr <= maps[i].high && (uint64_t)addr + len > maps[i].low) {
+      return true;
+    }
+  }
+  return false;
+}
+
 uint32_t mmio_read(paddr_t addr, int len, int map_NO) {
   assert(len >= 1 && len <= 4);
   MMIO_t *map = &maps[map_NO];
@@ -51,11 +63,13 @@ uint32_t mmio_read(paddr_t addr, int len, int map_NO) {
   if (map->callback != NULL) {
     map->callback(addr, len, false);
   }
+  mem_trace(TRACE_MMIO_READ, addr, len, data);
   return data;
 }
 
 void mmio_write(paddr_t addr, int len, uint32_t data, int map_NO) {
   assert(len >= 1 && len <= 4);
+  mem_trace(TRACE_MMIO_WRITE, addr, len, data);
   MMIO_t *map = &maps[map_NO];
 
   uint8_t *p = map->mmio_space + (addr - map->low);
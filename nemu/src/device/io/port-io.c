@@ -1,8 +1,9 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "memory/trace.h"
 
 #define PORT_IO_SPACE_MAX 65536
-#define NR_MAP 8
+#define NR_MAP 16
 
 /* "+ 3" is for hacking, see pio_read() below */
 static uint8_t pio_space[PORT_IO_SPACE_MAX + 3];
@@ -42,16 +43,20 @@ void* add_pio_map(ioaddr_t addr, int len, pio_callback_t callback) {
 static inline uint32_t pio_read_common(ioaddr_t addr, int len) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
   pio_callback(addr, len, false);		// prepare data to read
+  uint32_t data;
   switch (len) {
-    case 4: return *(uint32_t *)(pio_space + addr);
-    case 2: return *(uint16_t *)(pio_space + addr);
-    case 1: return *(uint8_t *)(pio_space + addr);
+    case 4: data = *(uint32_t *)(pio_space + addr); break;
+    case 2: data = *(uint16_t *)(pio_space + addr); break;
+    case 1: data = *(uint8_t *)(pio_space + addr); break;
     default: assert(0);
   }
+  mem_trace(TRACE_PIO_IN, addr, len, data);
+  return data;
 }
 
 static inline void pio_write_common(ioaddr_t addr, uint32_t data, int len) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
+  mem_trace(TRACE_PIO_OUT, addr, len, data);
   switch (len) {
     case 4: *(uint32_t *)(pio_space + addr) = data; break;
     case 2: *(uint16_t *)(pio_space + addr) = data; break;
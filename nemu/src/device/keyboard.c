@@ -1,4 +1,5 @@
 #include "device/port-io.h"
+#include "device/replay.h"
 #include "monitor/monitor.h"
 #include <SDL2/SDL.h>
 
@@ -35,13 +36,19 @@ static int key_f = 0, key_r = 0;
 
 #define KEYDOWN_MASK 0x8000
 
+/* also used to feed the key events from the replay journal */
+void send_am_key(uint32_t am_scancode) {
+  replay_record(REPLAY_EV_KEY, am_scancode);
+  key_queue[key_r] = am_scancode;
+  key_r = (key_r + 1) % KEY_QUEUE_LEN;
+  Assert(key_r != key_f, "key queue overflow!");
+}
+
 void send_key(uint8_t scancode, bool is_keydown) {
   if (nemu_state == NEMU_RUNNING &&
       keymap[scancode] != _KEY_NONE) {
     uint32_t am_scancode = keymap[scancode] | (is_keydown ? KEYDOWN_MASK : 0);
-    key_queue[key_r] = am_scancode;
-    key_r = (key_r + 1) % KEY_QUEUE_LEN;
-    Assert(key_r != key_f, "key queue overflow!");
+    send_am_key(am_scancode);
   }
 }
 
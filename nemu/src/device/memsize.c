@@ -0,0 +1,13 @@
+#include "common.h"
+#include "device/port-io.h"
+#include "memory/memory.h"
+
+/* The guest reads the size of the physical memory in bytes from this
+ * register, since it can be changed by the `-m' option.
+ */
+#define MEMSIZE_PORT 0x480 // Note that this is not the standard
+
+void init_memsize() {
+  uint32_t *memsize_base = add_pio_map(MEMSIZE_PORT, 4, NULL);
+  memsize_base[0] = pmem_size;
+}
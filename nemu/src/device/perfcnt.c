@@ -0,0 +1,66 @@
+#include "common.h"
+#include "device/port-io.h"
+#include "monitor/monitor.h"
+#include "cpu/perfcnt.h"
+#include <time.h>
+
+/* Writing PERFCNT_CTRL either latches the counters into the 64-bit
+ * registers following it, or resets all of them to zero. Counters read
+ * by the guest are relative to the last reset. Other commands are
+ * ignored, a buggy guest must not be able to stop NEMU.
+ */
+#define PERFCNT_PORT 0x400 // Note that this is not the standard
+#define CTRL_OFFSET 0
+#define CNT_OFFSET 8
+
+#define PERFCNT_LATCH 1
+#define PERFCNT_RESET 2
+
+enum { CNT_INSTR, CNT_LOAD, CNT_STORE, CNT_BRANCH, CNT_TLB_MISS, CNT_INTR, CNT_HOST_NS, NR_CNT };
+
+static uint32_t *perfcnt_ctrl_base;
+static uint64_t *perfcnt_cnt_base;
+static uint64_t cnt_reset[NR_CNT];
+
+static uint64_t get_host_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void get_counters(uint64_t *cnt) {
+  cnt[CNT_INSTR] = get_nr_guest_instr();
+  cnt[CNT_LOAD] = perfcnt.load;
+  cnt[CNT_STORE] = perfcnt.store;
+  cnt[CNT_BRANCH] = perfcnt.branch_taken;
+  cnt[CNT_TLB_MISS] = perfcnt.tlb_miss;
+  cnt[CNT_INTR] = perfcnt.intr;
+  cnt[CNT_HOST_NS] = get_host_ns();
+}
+
+static void perfcnt_io_handler(ioaddr_t addr, int len, bool is_write) {
+  if (!is_write || addr != PERFCNT_PORT + CTRL_OFFSET) return;
+
+  uint64_t cnt[NR_CNT];
+  int i;
+  get_counters(cnt);
+  switch (perfcnt_ctrl_base[0]) {
+    case PERFCNT_LATCH:
+      for (i = 0; i < NR_CNT; i ++) {
+        perfcnt_cnt_base[i] = cnt[i] - cnt_reset[i];
+      }
+      break;
+    case PERFCNT_RESET:
+      memcpy(cnt_reset, cnt, sizeof(cnt_reset));
+      memset(perfcnt_cnt_base, 0, sizeof(uint64_t) * NR_CNT);
+      break;
+    default: break;
+  }
+}
+
+void init_perfcnt() {
+  uint8_t *p = add_pio_map(PERFCNT_PORT, CNT_OFFSET + sizeof(uint64_t) * NR_CNT, perfcnt_io_handler);
+  perfcnt_ctrl_base = (void *)(p + CTRL_OFFSET);
+  perfcnt_cnt_base = (void *)(p + CNT_OFFSET);
+  get_counters(cnt_reset);
+}
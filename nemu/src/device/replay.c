@@ -0,0 +1,142 @@
+#include "device/replay.h"
+#include "monitor/monitor.h"
+#include <stdlib.h>
+
+/* Journal format:
+ *   header: "NEMUJRNL" followed by the version as a 32-bit integer
+ *   record: type (1 byte), the instruction count delta since the previous
+ *           record (LEB128), and the payload (LEB128, RTC and key only)
+ */
+
+#define JOURNAL_MAGIC "NEMUJRNL"
+#define JOURNAL_VERSION 1
+
+typedef struct {
+  int type;
+  uint64_t instr;
+  uint32_t data;
+} Record;
+
+static int mode = REPLAY_OFF;
+static FILE *journal = NULL;
+static uint64_t last_instr = 0;
+static Record next;
+static bool is_end = false;
+
+extern void send_am_key(uint32_t am_scancode);
+extern void timer_intr();
+
+static void write_uleb128(uint64_t val) {
+  do {
+    uint8_t byte = val & 0x7f;
+    val >>= 7;
+    if (val != 0) byte |= 0x80;
+    putc(byte, journal);
+  } while (val != 0);
+}
+
+static bool read_uleb128(uint64_t *val) {
+  int shift = 0, c;
+  *val = 0;
+  do {
+    if ((c = getc(journal)) == EOF) return false;
+    *val |= (uint64_t)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return true;
+}
+
+static void fetch_next() {
+  int type = getc(journal);
+  uint64_t delta, data = 0;
+  if (type == EOF || !read_uleb128(&delta) ||
+      (type != REPLAY_EV_TIMER && !read_uleb128(&data))) {
+    Log("replay: end of journal at instruction %ld", get_nr_guest_instr());
+    is_end = true;
+    return;
+  }
+  next.type = type;
+  next.instr = last_instr + delta;
+  next.data = data;
+  last_instr = next.instr;
+}
+
+static void replay_close() {
+  if (journal != NULL) {
+    fclose(journal);
+    journal = NULL;
+  }
+}
+
+void init_replay(int m, const char *file) {
+  mode = m;
+  if (mode == REPLAY_OFF) return;
+
+  char magic[8];
+  uint32_t version = JOURNAL_VERSION;
+  journal = fopen(file, (mode == REPLAY_RECORD ? "wb" : "rb"));
+  Assert(journal, "Can not open '%s'", file);
+
+  if (mode == REPLAY_RECORD) {
+    fwrite(JOURNAL_MAGIC, sizeof(magic), 1, journal);
+    fwrite(&version, sizeof(version), 1, journal);
+    Log("Recording device inputs to %s", file);
+  }
+  else {
+    int ret = fread(magic, sizeof(magic), 1, journal);
+    ret += fread(&version, sizeof(version), 1, journal);
+    Assert(ret == 2 && memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) == 0,
+        "'%s' is not a journal of NEMU", file);
+    Assert(version == JOURNAL_VERSION, "unsupported journal version %d", version);
+    Log("Replaying device inputs from %s", file);
+    fetch_next();
+  }
+
+  atexit(replay_close);
+}
+
+int replay_mode() {
+  return mode;
+}
+
+void replay_record(int type, uint32_t data) {
+  if (mode != REPLAY_RECORD) return;
+
+  uint64_t instr = get_nr_guest_instr();
+  putc(type, journal);
+  write_uleb128(instr - last_instr);
+  if (type != REPLAY_EV_TIMER) {
+    write_uleb128(data);
+  }
+  last_instr = instr;
+}
+
+/* Deliver the asynchronous events which are due. */
+void replay_update() {
+  uint64_t now = get_nr_guest_instr();
+  while (!is_end && next.type != REPLAY_EV_RTC && next.instr <= now) {
+    switch (next.type) {
+      case REPLAY_EV_KEY: send_am_key(next.data); break;
+      case REPLAY_EV_TIMER: timer_intr(); break;
+      default: panic("replay: bad record type %d", next.type);
+    }
+    fetch_next();
+  }
+}
+
+uint32_t replay_rtc(uint32_t val) {
+  switch (mode) {
+    case REPLAY_RECORD: replay_record(REPLAY_EV_RTC, val); break;
+    case REPLAY_PLAY:
+      if (is_end) break;
+      Assert(next.type == REPLAY_EV_RTC && next.instr == get_nr_guest_instr(),
+          "replay diverges at instruction %ld: expect record type %d at instruction %ld",
+          get_nr_guest_instr(), next.type, next.instr);
+      val = next.data;
+      fetch_next();
+      /* events following the read in the same instruction */
+      replay_update();
+      break;
+  }
+  return val;
+}
@@ -1,5 +1,9 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "memory/memory.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 
@@ -7,17 +11,71 @@
 #define CH_OFFSET 0
 #define LSR_OFFSET 5		/* line status register */
 
+/* The guest writes the physical address of a buffer to BULK_ADDR, then
+ * writes its length to BULK_LEN to transmit the whole buffer at once.
+ */
+#define SERIAL_BULK_PORT 0x3E0 // Note that this is not the standard
+#define BULK_ADDR_OFFSET 0
+#define BULK_LEN_OFFSET 4
+
+/* Output is buffered on the host side, and flushed when the buffer is full,
+ * periodically by device_update(), and when the CPU stops.
+ */
+#define OBUF_SIZE 4096
+
 static uint8_t *serial_ch_base;
 static uint8_t *serial_lsr_base;
+static uint32_t *serial_bulk_base;
+
+static char obuf[OBUF_SIZE];
+static int obuf_len = 0;
+
+static void host_write(const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(STDOUT_FILENO, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+void serial_flush() {
+  if (obuf_len == 0) return;
+  /* keep the order with the messages printed by NEMU */
+  fflush(stdout);
+  host_write(obuf, obuf_len);
+  obuf_len = 0;
+}
 
 static void serial_ch_io_handler(ioaddr_t addr, int len, bool is_write) {
   assert(is_write);
   assert(len == 1);
-  char c = serial_ch_base[0];
   /* We bind the serial port with the host stdout in NEMU. */
-  putc(c, stdout);
-  if (c == '\n') {
-    fflush(stdout);
+  obuf[obuf_len ++] = serial_ch_base[0];
+  if (obuf_len == OBUF_SIZE) {
+    serial_flush();
+  }
+}
+
+static void serial_bulk_io_handler(ioaddr_t addr, int len, bool is_write) {
+  if (!is_write || addr != SERIAL_BULK_PORT + BULK_LEN_OFFSET) return;
+
+  /* a physical address, the guest translates its pointer */
+  paddr_t src = serial_bulk_base[BULK_ADDR_OFFSET / 4];
+  uint32_t n = serial_bulk_base[BULK_LEN_OFFSET / 4];
+  /* a request out of the physical memory is dropped */
+  if ((uint64_t)src + n > pmem_size) return;
+
+  if (obuf_len + n <= OBUF_SIZE) {
+    memcpy(obuf + obuf_len, guest_to_host(src), n);
+    obuf_len += n;
+  }
+  else {
+    serial_flush();
+    host_write(guest_to_host(src), n);
   }
 }
 
@@ -25,4 +83,6 @@ void init_serial() {
   serial_ch_base = add_pio_map(SERIAL_PORT + CH_OFFSET, 1, serial_ch_io_handler);
   serial_lsr_base = add_pio_map(SERIAL_PORT + LSR_OFFSET, 1, NULL);
   serial_lsr_base[0] = 0x20; /* the status is always free */
+  serial_bulk_base = add_pio_map(SERIAL_BULK_PORT, 8, serial_bulk_io_handler);
+  atexit(serial_flush);
 }
@@ -1,25 +1,57 @@
 #include "device/port-io.h"
+#include "device/replay.h"
+#include "device/timer.h"
 #include "monitor/monitor.h"
+#include "cpu/intr.h"
 #include <sys/time.h>
 
 #define RTC_PORT 0x48   // Note that this is not the standard
 
 void timer_intr() {
   if (nemu_state == NEMU_RUNNING) {
-    extern void dev_raise_intr(void);
-    dev_raise_intr();
+    replay_record(REPLAY_EV_TIMER, 0);
+    dev_raise_irq(IRQ_TIMER);
   }
 }
 
 static uint32_t *rtc_port_base;
 
+/* nominal frequency of the guest in virtual time mode, 0 means disabled */
+static uint32_t vclock_mhz = 0;
+
+void init_vclock(uint32_t mhz) {
+  vclock_mhz = mhz;
+  if (mhz != 0) {
+    Log("Virtual time: \33[1;32m%s\33[0m, nominal frequency = %d MHz", "ON", mhz);
+  }
+}
+
+bool vclock_enabled() {
+  return vclock_mhz != 0;
+}
+
+uint64_t vclock_us() {
+  return get_nr_guest_instr() / vclock_mhz;
+}
+
+uint64_t vclock_instr_per_sec() {
+  return (uint64_t)vclock_mhz * 1000000;
+}
+
 void rtc_io_handler(ioaddr_t addr, int len, bool is_write) {
   if (!is_write) {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    uint32_t seconds = now.tv_sec;
-    uint32_t useconds = now.tv_usec;
-    rtc_port_base[0] = seconds * 1000 + (useconds + 500) / 1000;
+    uint32_t ms;
+    if (vclock_enabled()) {
+      ms = (vclock_us() + 500) / 1000;
+    }
+    else {
+      struct timeval now;
+      gettimeofday(&now, NULL);
+      uint32_t seconds = now.tv_sec;
+      uint32_t useconds = now.tv_usec;
+      ms = seconds * 1000 + (useconds + 500) / 1000;
+    }
+    rtc_port_base[0] = replay_rtc(ms);
   }
 }
 
@@ -3,7 +3,9 @@
 #ifdef HAS_IOE
 
 #include "device/mmio.h"
+#include "memory/memory.h"
 #include "device/port-io.h"
+#include "device/replay.h"
 #include <SDL2/SDL.h>
 
 #define VMEM 0x40000
@@ -12,29 +14,82 @@
 #define SCREEN_H 300
 #define SCREEN_W 400
 
+/* The blit engine copies a rectangle of pixels from the guest memory
+ * to the frame buffer on the host side. The guest fills in the
+ * descriptor and then writes BLIT_CMD. A command whose source is out of
+ * the physical memory is ignored.
+ */
+#define BLIT_MMIO (VMEM + 0x80000) // Note that this is not the standard
+
+enum {
+  BLIT_SRC,     // guest physical address of the pixels
+  BLIT_X, BLIT_Y, BLIT_W, BLIT_H,
+  BLIT_PITCH,   // number of pixels per line in the source
+  BLIT_SYNC,    // sync the screen after the copy if not 0
+  BLIT_CMD,
+  NR_BLIT_REG
+};
+
 static SDL_Window *window;
 static SDL_Renderer *renderer;
 static SDL_Texture *texture;
 
 static uint32_t (*vmem) [SCREEN_W];
 static uint32_t *screensize_port_base;
+static uint32_t *blit_base;
 
 void update_screen() {
+  if (texture == NULL) return;
+
   SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(vmem[0][0]));
   SDL_RenderClear(renderer);
   SDL_RenderCopy(renderer, texture, NULL, NULL);
   SDL_RenderPresent(renderer);
 }
 
+static void blit_handler(paddr_t addr, int len, bool is_write) {
+  if (!is_write || addr != BLIT_MMIO + BLIT_CMD * 4) return;
+
+  uint32_t x = blit_base[BLIT_X], y = blit_base[BLIT_Y];
+  uint32_t w = blit_base[BLIT_W], h = blit_base[BLIT_H];
+  uint32_t pitch = blit_base[BLIT_PITCH];
+  paddr_t src = blit_base[BLIT_SRC];
+
+  /* clip the rectangle to the screen, without overflowing on huge values */
+  uint32_t w_copy = (x >= SCREEN_W ? 0 : ((uint64_t)x + w > SCREEN_W ? SCREEN_W - x : w));
+  uint32_t h_copy = (y >= SCREEN_H ? 0 : ((uint64_t)y + h > SCREEN_H ? SCREEN_H - y : h));
+
+  if (w_copy > 0 && h_copy > 0) {
+    /* a command with a bad source is ignored, the guest can not stop NEMU */
+    if (src + ((uint64_t)(h_copy - 1) * pitch + w_copy) * sizeof(uint32_t) > pmem_size) return;
+    uint32_t *p = guest_to_host(src);
+    uint32_t i;
+    for (i = 0; i < h_copy; i ++) {
+      memcpy(&vmem[y + i][x], p, w_copy * sizeof(uint32_t));
+      p += pitch;
+    }
+  }
+
+  if (blit_base[BLIT_SYNC]) {
+    update_screen();
+  }
+}
+
 void init_vga() {
+  screensize_port_base = add_pio_map(SCREEN_PORT, 4, NULL);
+  *screensize_port_base = ((SCREEN_W) << 16) | (SCREEN_H);
+  vmem = add_mmio_map(VMEM, 0x80000, NULL);
+  blit_base = add_mmio_map(BLIT_MMIO, NR_BLIT_REG * 4, blit_handler);
+
+  if (replay_mode() == REPLAY_PLAY) {
+    /* run headless at full speed */
+    return;
+  }
+
   SDL_Init(SDL_INIT_VIDEO);
   SDL_CreateWindowAndRenderer(SCREEN_W * 2, SCREEN_H * 2, 0, &window, &renderer);
   SDL_SetWindowTitle(window, "NEMU");
   texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
       SDL_TEXTUREACCESS_STATIC, SCREEN_W, SCREEN_H);
-
-  screensize_port_base = add_pio_map(SCREEN_PORT, 4, NULL);
-  *screensize_port_base = ((SCREEN_W) << 16) | (SCREEN_H);
-  vmem = add_mmio_map(VMEM, 0x80000, NULL);
 }
 #endif	/* HAS_IOE */
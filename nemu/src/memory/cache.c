@@ -0,0 +1,330 @@
+#include "nemu.h"
+
+#ifdef CACHE_SIM
+
+#include "memory/cache.h"
+#include "monitor/elf.h"
+#include "monitor/monitor.h"
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* The caches are write-back and write-allocate. L1I and L1D are backed by
+ * the unified L2, and the dirty lines evicted from L1D are written back
+ * into L2. Misses of each level are charged to the function containing
+ * the instruction which causes them, so that hot data structures can be
+ * found and laid out again.
+ *
+ * The hierarchy is given by `-c' in the form
+ *   l1i=32K:8:64:lru,l1d=32K:8:64:lru,l2=1M:16:64:lru
+ * that is SIZE:WAYS:LINE:POLICY for each level, where POLICY is one of
+ * lru, fifo and random. Omitted levels and fields keep the defaults
+ * below, and `l2=off' removes L2.
+ */
+
+enum { L1I, L1D, L2, NR_CACHE };
+enum { POLICY_LRU, POLICY_FIFO, POLICY_RANDOM };
+
+static const char *policy_name[] = { "lru", "fifo", "random" };
+
+typedef struct {
+  uint32_t addr;    // address of the line
+  uint64_t stamp;   // time of the last access (LRU) or of the fill (FIFO)
+  bool valid, dirty;
+} CacheLine;
+
+typedef struct Cache {
+  const char *name;
+  bool enable;
+  uint32_t size, ways, line_size;
+  int policy;
+
+  int line_shift;
+  uint32_t set_mask;
+  CacheLine *lines;
+  struct Cache *next;
+  uint64_t clock;
+
+  uint64_t access, hit, writeback;
+} Cache;
+
+static Cache caches[NR_CACHE] = {
+  [L1I] = { .name = "l1i", .enable = true, .size = 32 << 10, .ways = 8, .line_size = 64 },
+  [L1D] = { .name = "l1d", .enable = true, .size = 32 << 10, .ways = 8, .line_size = 64 },
+  [L2]  = { .name = "l2",  .enable = true, .size = 1 << 20,  .ways = 16, .line_size = 64 },
+};
+
+static uint32_t rand_state = 1;
+
+/* An instruction is fetched field by field, but each line it occupies
+ * is only accessed once. */
+static uint64_t last_fetch_instr = -1;
+static uint32_t last_fetch_line = -1;
+
+/* misses charged to functions */
+
+#define NR_FUNC_SLOT 1024   // power of 2
+
+typedef struct {
+  const char *name;
+  uint64_t miss[NR_CACHE];
+} FuncMiss;
+
+static FuncMiss func_miss[NR_FUNC_SLOT];
+static FuncMiss other_miss = { .name = "(others)" };
+static int nr_func = 0;
+static vaddr_t last_miss_eip = -1;
+static FuncMiss *last_miss_func = NULL;
+
+static FuncMiss *func_slot(vaddr_t eip) {
+  if (eip == last_miss_eip) return last_miss_func;
+
+  const char *name = elf_func_name(eip);
+  if (name == NULL) { name = "(unknown)"; }
+
+  /* the names are kept by the symbol table, compare the pointers */
+  uint32_t h = ((uintptr_t)name * 2654435761u) & (NR_FUNC_SLOT - 1);
+  FuncMiss *f = &other_miss;
+  int i;
+  for (i = 0; i < NR_FUNC_SLOT; i ++, h = (h + 1) & (NR_FUNC_SLOT - 1)) {
+    if (func_miss[h].name == name) { f = &func_miss[h]; break; }
+    if (func_miss[h].name == NULL) {
+      /* keep the table at most half full */
+      if (nr_func < NR_FUNC_SLOT / 2) {
+        func_miss[h].name = name;
+        nr_func ++;
+        f = &func_miss[h];
+      }
+      break;
+    }
+  }
+
+  last_miss_eip = eip;
+  last_miss_func = f;
+  return f;
+}
+
+static CacheLine *choose_victim(Cache *c, CacheLine *set) {
+  uint32_t i;
+  for (i = 0; i < c->ways; i ++) {
+    if (!set[i].valid) return &set[i];
+  }
+
+  if (c->policy == POLICY_RANDOM) {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return &set[rand_state % c->ways];
+  }
+
+  /* the oldest stamp is the least recently used or the first filled */
+  CacheLine *victim = &set[0];
+  for (i = 1; i < c->ways; i ++) {
+    if (set[i].stamp < victim->stamp) { victim = &set[i]; }
+  }
+  return victim;
+}
+
+/* access the line containing `addr', return whether it hits */
+static bool cache_line_access(Cache *c, uint32_t addr, bool is_write) {
+  addr &= ~(c->line_size - 1);
+  CacheLine *set = &c->lines[((addr >> c->line_shift) & c->set_mask) * c->ways];
+  c->access ++;
+  c->clock ++;
+
+  uint32_t i;
+  for (i = 0; i < c->ways; i ++) {
+    if (set[i].valid && set[i].addr == addr) {
+      if (c->policy == POLICY_LRU) { set[i].stamp = c->clock; }
+      set[i].dirty |= is_write;
+      c->hit ++;
+      return true;
+    }
+  }
+
+  func_slot(cpu.eip)->miss[c - caches] ++;
+
+  CacheLine *victim = choose_victim(c, set);
+  if (victim->valid && victim->dirty) {
+    c->writeback ++;
+    if (c->next != NULL) { cache_line_access(c->next, victim->addr, true); }
+  }
+  if (c->next != NULL) { cache_line_access(c->next, addr, false); }
+
+  victim->addr = addr;
+  victim->stamp = c->clock;
+  victim->valid = true;
+  victim->dirty = is_write;
+  return false;
+}
+
+static inline Cache *l1(int type) {
+  return &caches[type == CACHE_IFETCH ? L1I : L1D];
+}
+
+void cache_access(vaddr_t addr, int len, int type) {
+  Cache *c = l1(type);
+  if (type == CACHE_IFETCH) {
+    uint32_t line = addr >> c->line_shift;
+    uint32_t last_line = (addr + len - 1) >> c->line_shift;
+    uint64_t instr = get_nr_guest_instr();
+    if (instr == last_fetch_instr && line == last_fetch_line) {
+      if (last_line == line) return;
+      addr = last_line << c->line_shift;
+      len = 1;
+    }
+    last_fetch_instr = instr;
+    last_fetch_line = last_line;
+  }
+
+  bool is_write = (type == CACHE_STORE);
+  cache_line_access(c, addr, is_write);
+  /* unaligned accesses may cross two lines */
+  if (((addr ^ (addr + len - 1)) & ~(c->line_size - 1)) != 0) {
+    cache_line_access(c, addr + len - 1, is_write);
+  }
+}
+
+/* `n' accesses of `width' bytes to consecutive addresses from `addr',
+ * as performed by the string instructions. Only the first access to
+ * each line is looked up, the others are sure to hit and are counted
+ * directly. */
+void cache_access_run(vaddr_t addr, uint32_t n, int width, int type) {
+  Cache *c = l1(type);
+  bool is_write = (type == CACHE_STORE);
+  vaddr_t end = addr + n * width;
+
+  while (addr < end) {
+    vaddr_t line_end = (addr | (c->line_size - 1)) + 1;
+    if (line_end > end || line_end == 0) { line_end = end; }
+    uint32_t k = (line_end - addr + width - 1) / width;
+    cache_line_access(c, addr, is_write);
+    c->access += k - 1;
+    c->hit += k - 1;
+    addr += k * width;
+  }
+}
+
+static uint32_t parse_size(const char *s, char **end) {
+  uint32_t size = strtoul(s, end, 10);
+  switch (**end) {
+    case 'k': case 'K': size <<= 10; (*end) ++; break;
+    case 'm': case 'M': size <<= 20; (*end) ++; break;
+    default: break;
+  }
+  return size;
+}
+
+static void parse_level(Cache *c, char *s) {
+  if (strcmp(s, "off") == 0) {
+    c->enable = false;
+    return;
+  }
+
+  char *p = s;
+  c->size = parse_size(p, &p);
+  if (*p == ':') { c->ways = strtoul(p + 1, &p, 10); }
+  if (*p == ':') { c->line_size = strtoul(p + 1, &p, 10); }
+  if (*p == ':') {
+    p ++;
+    int i;
+    for (i = 0; i < sizeof(policy_name) / sizeof(policy_name[0]); i ++) {
+      if (strcmp(p, policy_name[i]) == 0) break;
+    }
+    if (i == sizeof(policy_name) / sizeof(policy_name[0])) {
+      panic("Unknown replacement policy '%s' of %s, use lru, fifo or random", p, c->name);
+    }
+    c->policy = i;
+    p += strlen(p);
+  }
+  if (*p != '\0') { panic("Bad configuration '%s' of %s", s, c->name); }
+}
+
+static void parse_spec(const char *spec) {
+  char *buf = strdup(spec);
+  char *save = NULL, *item;
+  for (item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+    char *eq = strchr(item, '=');
+    if (eq == NULL) { panic("Bad cache configuration '%s'", item); }
+    *eq = '\0';
+
+    int i;
+    for (i = 0; i < NR_CACHE; i ++) {
+      if (strcmp(item, caches[i].name) == 0) break;
+    }
+    if (i == NR_CACHE) { panic("Unknown cache '%s', use l1i, l1d or l2", item); }
+    parse_level(&caches[i], eq + 1);
+  }
+  free(buf);
+}
+
+void init_cache(const char *spec) {
+  if (spec != NULL) { parse_spec(spec); }
+  Assert(caches[L1I].enable && caches[L1D].enable, "L1 caches can not be removed");
+
+  int i;
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &caches[i];
+    if (!c->enable) continue;
+
+    uint32_t line = c->line_size;
+    Assert(line >= 4 && (line & (line - 1)) == 0, "line size of %s must be a power of 2", c->name);
+    Assert(c->ways > 0 && c->size % (c->ways * line) == 0,
+        "size of %s must be a multiple of ways * line size", c->name);
+    uint32_t nr_set = c->size / (c->ways * line);
+    Assert(nr_set > 0 && (nr_set & (nr_set - 1)) == 0,
+        "number of sets of %s must be a power of 2", c->name);
+
+    c->line_shift = __builtin_ctz(line);
+    c->set_mask = nr_set - 1;
+    c->lines = calloc(nr_set * c->ways, sizeof(CacheLine));
+    Assert(c->lines, "Can not allocate %s", c->name);
+
+    Log("%s: %u KB, %u-way, %u-byte lines, %s", c->name, c->size >> 10,
+        c->ways, line, policy_name[c->policy]);
+  }
+
+  Cache *l2 = (caches[L2].enable ? &caches[L2] : NULL);
+  caches[L1I].next = caches[L1D].next = l2;
+}
+
+#define NR_TOP_FUNC 20
+
+static int func_miss_cmp(const void *a, const void *b) {
+  const FuncMiss *fa = *(FuncMiss **)a, *fb = *(FuncMiss **)b;
+  uint64_t ma = fa->miss[L1I] + fa->miss[L1D] + fa->miss[L2];
+  uint64_t mb = fb->miss[L1I] + fb->miss[L1D] + fb->miss[L2];
+  return (ma < mb) - (ma > mb);
+}
+
+void cache_report() {
+  int i;
+  printflog("%-6s %14s %14s %14s %9s %12s\n", "cache", "accesses", "hits", "misses",
+      "hit rate", "writebacks");
+  for (i = 0; i < NR_CACHE; i ++) {
+    Cache *c = &caches[i];
+    if (!c->enable) continue;
+    printflog("%-6s %14" PRIu64 " %14" PRIu64 " %14" PRIu64 " %8.2f%% %12" PRIu64 "\n",
+        c->name, c->access, c->hit, c->access - c->hit,
+        (c->access == 0 ? 0 : 100.0 * c->hit / c->access), c->writeback);
+  }
+
+  static FuncMiss *sorted[NR_FUNC_SLOT + 1];
+  int n = 0;
+  for (i = 0; i < NR_FUNC_SLOT; i ++) {
+    if (func_miss[i].name != NULL) { sorted[n ++] = &func_miss[i]; }
+  }
+  if (other_miss.miss[L1I] + other_miss.miss[L1D] + other_miss.miss[L2] != 0) {
+    sorted[n ++] = &other_miss;
+  }
+  if (n == 0) return;
+  qsort(sorted, n, sizeof(sorted[0]), func_miss_cmp);
+
+  printflog("%-24s %14s %14s %14s\n", "function", "l1i misses", "l1d misses", "l2 misses");
+  for (i = 0; i < n && i < NR_TOP_FUNC; i ++) {
+    FuncMiss *f = sorted[i];
+    printflog("%-24s %14" PRIu64 " %14" PRIu64 " %14" PRIu64 "\n",
+        f->name, f->miss[L1I], f->miss[L1D], f->miss[L2]);
+  }
+}
+
+#endif
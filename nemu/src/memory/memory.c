@@ -1,28 +1,172 @@
 #include "nemu.h"
+#include "device/mmio.h"
+#include "cpu/intr.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <inttypes.h>
+#include <unistd.h>
 
-#define PMEM_SIZE (128 * 1024 * 1024)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
-#define pmem_rw(addr, type) *(type *)({\
-    Assert(addr < PMEM_SIZE, "physical address(0x%08x) is out of bound", addr); \
+/* the mapping of the physical memory has exactly `pmem_size' bytes, so
+ * the whole access must be in it */
+#define pmem_rw(addr, len) ({\
+    Assert((uint64_t)addr + len <= pmem_size, "physical address(0x%08x) is out of bound", addr); \
     guest_to_host(addr); \
     })
 
-uint8_t pmem[PMEM_SIZE];
+NEMU_TLS uint8_t *pmem = NULL;
+NEMU_TLS uint32_t pmem_size = PMEM_SIZE_DEFAULT;
+
+static int dtlb_fd = -1;
+
+#ifndef _SHARE
+/* Count the data TLB misses of NEMU itself. This may be forbidden by
+ * perf_event_paranoid, and then nothing is reported. */
+static void init_dtlb_counter() {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  dtlb_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+/* The physical memory is an anonymous mapping, so that pages are only
+ * allocated when the guest touches them, and segments of ELF images can
+ * be mapped into it. With `huge', it is backed by transparent huge pages
+ * or by pages from hugetlbfs, which must be reserved by the host.
+ */
+void init_mem(uint32_t size, int huge) {
+  if (size != 0) { pmem_size = size; }
+  Assert(pmem_size <= PMEM_SIZE_MAX, "physical memory of %u MB is too large", pmem_size >> 20);
+
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+  pmem = MAP_FAILED;
+  if (huge == PMEM_HUGE_TLB) {
+    pmem_size = (pmem_size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    /* reserve the huge pages now, instead of failing at the first touch */
+    pmem = mmap(NULL, pmem_size, PROT_READ | PROT_WRITE,
+        (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+    if (pmem == MAP_FAILED) {
+      Log("Can not allocate huge pages, fall back to transparent huge pages");
+      huge = PMEM_HUGE_THP;
+    }
+  }
+  if (pmem == MAP_FAILED) {
+    /* over-allocate to align the memory to huge pages */
+    size_t len = pmem_size + (huge == PMEM_HUGE_THP ? HUGE_PAGE_SIZE : 0);
+    uint8_t *p = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    Assert(p != MAP_FAILED, "Can not allocate the physical memory");
+    pmem = p;
+    if (huge == PMEM_HUGE_THP) {
+      pmem = (uint8_t *)(((uintptr_t)p + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+      if (pmem != p) { munmap(p, pmem - p); }
+      munmap(pmem + pmem_size, p + len - (pmem + pmem_size));
+      if (madvise(pmem, pmem_size, MADV_HUGEPAGE) != 0) {
+        Log("Transparent huge pages are not available");
+      }
+    }
+  }
+
+#ifndef _SHARE
+  init_dtlb_counter();
+#endif
+}
+
+/* Zero the physical memory by mapping fresh pages over it, which also
+ * drops the pages mapped from an image loaded before. It is not for the
+ * memory backed by hugetlbfs. */
+bool reset_mem() {
+  void *p = mmap(pmem, pmem_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+  return p != MAP_FAILED;
+}
+
+void mem_statistic() {
+  long size, pages = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp != NULL) {
+    if (fscanf(fp, "%ld %ld", &size, &pages) != 2) { pages = 0; }
+    fclose(fp);
+  }
+  Log("physical memory = %u MB, host RSS = %ld KB", pmem_size >> 20,
+      pages * (sysconf(_SC_PAGESIZE) / 1024));
+
+  uint64_t dtlb_miss;
+  if (dtlb_fd >= 0 && read(dtlb_fd, &dtlb_miss, sizeof(dtlb_miss)) == sizeof(dtlb_miss)) {
+    Log("host dTLB load misses = %" PRIu64, dtlb_miss);
+  }
+}
 
 /* Memory accessing interfaces */
 
 uint32_t paddr_read(paddr_t addr, int len) {
-  return pmem_rw(addr, uint32_t) & (~0u >> ((4 - len) << 3));
+  int map_NO = is_mmio(addr);
+  if (map_NO != -1) {
+    return mmio_read(addr, len, map_NO);
+  }
+  void *p = pmem_rw(addr, len);
+  switch (len) {
+    case 4: return *(uint32_t *)p;
+    case 1: return *( uint8_t *)p;
+    case 2: return *(uint16_t *)p;
+    default: assert(0);
+  }
 }
 
 void paddr_write(paddr_t addr, uint32_t data, int len) {
-  memcpy(guest_to_host(addr), &data, len);
+  int map_NO = is_mmio(addr);
+  if (map_NO != -1) {
+    mmio_write(addr, len, data, map_NO);
+    return;
+  }
+  memcpy(pmem_rw(addr, len), &data, len);
+}
+
+/* Translate by the page tables if paging is enabled by cr0. Page faults
+ * are not modeled yet. */
+paddr_t page_translate(vaddr_t addr) {
+  if (!cpu.cr0.paging) return addr;
+
+  PDE pde;
+  pde.val = paddr_read((cpu.cr3.page_directory_base << 12) + (addr >> 22) * 4, 4);
+  Assert(pde.present, "page directory entry of 0x%08x is not present", addr);
+  PTE pte;
+  pte.val = paddr_read((pde.page_frame << 12) + ((addr >> 12) & (NR_PTE - 1)) * 4, 4);
+  Assert(pte.present, "page table entry of 0x%08x is not present", addr);
+  return (pte.page_frame << 12) | (addr & PAGE_MASK);
+}
+
+static inline bool cross_page(vaddr_t addr, int len) {
+  return cpu.cr0.paging && (addr & PAGE_MASK) + len > PAGE_SIZE;
 }
 
 uint32_t vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  if (cross_page(addr, len)) {
+    uint32_t data = 0;
+    int i;
+    for (i = 0; i < len; i ++) {
+      data |= paddr_read(page_translate(addr + i), 1) << (i * 8);
+    }
+    return data;
+  }
+  return paddr_read(page_translate(addr), len);
 }
 
 void vaddr_write(vaddr_t addr, uint32_t data, int len) {
-  paddr_write(addr, data, len);
+  idt_watch(addr, len);
+  if (cross_page(addr, len)) {
+    int i;
+    for (i = 0; i < len; i ++) {
+      paddr_write(page_translate(addr + i), (data >> (i * 8)) & 0xff, 1);
+    }
+    return;
+  }
+  paddr_write(page_translate(addr), data, len);
 }
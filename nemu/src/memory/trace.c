@@ -0,0 +1,195 @@
+#include "nemu.h"
+
+#ifdef MEM_TRACE
+
+#include "memory/trace.h"
+#include "monitor/monitor.h"
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+/* Records are encoded into one of NR_BLOCK blocks. A full block is handed
+ * to the writer thread, which compresses it and writes it to the file,
+ * while the guest goes on with the next block. The guest only waits when
+ * all blocks are full.
+ *
+ * The trace is closed at exit, and also when NEMU aborts (e.g. by a failed
+ * Assert()), since the records leading to the failure matter most.
+ */
+
+#define BLOCK_SIZE (1 << 20)
+#define NR_BLOCK 8
+#define RECORD_MAX 32
+
+bool mem_trace_on = false;
+
+static FILE *trace_fp = NULL;
+static uint8_t *block[NR_BLOCK];
+static uint32_t block_len[NR_BLOCK];
+static bool block_full[NR_BLOCK];
+static int cur = 0;
+static uint8_t *p_cur = NULL, *p_limit = NULL;
+
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static bool quit = false;
+static bool closed = false;
+
+/* deltas are against the last record of the block */
+static uint64_t prev_instr;
+static uint32_t prev_addr, prev_eip;
+
+static uint64_t nr_record = 0, raw_bytes = 0, file_bytes = 0;
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p ++ = v | 0x80;
+    v >>= 7;
+  }
+  *p ++ = v;
+  return p;
+}
+
+static inline uint32_t zigzag(uint32_t delta) {
+  return (delta << 1) ^ -(delta >> 31);
+}
+
+static void write_block(uint8_t *data, uint32_t len) {
+  uint32_t hdr[2] = { len, len };
+  void *out = data;
+#ifdef HAS_ZSTD
+  static void *zbuf = NULL;
+  if (zbuf == NULL) {
+    zbuf = malloc(ZSTD_compressBound(BLOCK_SIZE));
+    Assert(zbuf, "Can not allocate the buffer of zstd");
+  }
+  size_t ret = ZSTD_compress(zbuf, ZSTD_compressBound(BLOCK_SIZE), data, len, 1);
+  Assert(!ZSTD_isError(ret), "zstd: %s", ZSTD_getErrorName(ret));
+  hdr[1] = ret;
+  out = zbuf;
+#endif
+  size_t ok = fwrite(hdr, sizeof(hdr), 1, trace_fp);
+  ok += fwrite(out, hdr[1], 1, trace_fp);
+  Assert(ok == 2, "Can not write the memory trace");
+  file_bytes += sizeof(hdr) + hdr[1];
+}
+
+static void *writer_main(void *arg) {
+  int i = 0;
+  pthread_mutex_lock(&lock);
+  while (true) {
+    while (!block_full[i] && !quit) { pthread_cond_wait(&cond, &lock); }
+    /* the blocks are written in order, and all of them before quitting */
+    if (!block_full[i]) break;
+    pthread_mutex_unlock(&lock);
+
+    write_block(block[i], block_len[i]);
+
+    pthread_mutex_lock(&lock);
+    block_full[i] = false;
+    pthread_cond_broadcast(&cond);
+    i = (i + 1) % NR_BLOCK;
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+static void start_block() {
+  p_cur = block[cur];
+  p_limit = block[cur] + BLOCK_SIZE - RECORD_MAX;
+  prev_instr = 0;
+  prev_addr = prev_eip = 0;
+}
+
+static void submit_block() {
+  pthread_mutex_lock(&lock);
+  block_len[cur] = p_cur - block[cur];
+  raw_bytes += block_len[cur];
+  block_full[cur] = true;
+  pthread_cond_broadcast(&cond);
+  cur = (cur + 1) % NR_BLOCK;
+  while (block_full[cur]) { pthread_cond_wait(&cond, &lock); }
+  pthread_mutex_unlock(&lock);
+  start_block();
+}
+
+void mem_trace_record(int kind, uint32_t addr, int width, uint32_t value) {
+  uint8_t *p = p_cur;
+  uint64_t instr = get_nr_guest_instr();
+  vaddr_t eip = cpu.eip;
+  bool new_eip = (eip != prev_eip);
+
+  *p ++ = kind | (__builtin_ctz(width) << TRACE_WIDTH_SHIFT) | (new_eip ? TRACE_NEW_EIP : 0);
+  p = put_varint(p, instr - prev_instr);
+  p = put_varint(p, zigzag(addr - prev_addr));
+  if (new_eip) { p = put_varint(p, zigzag(eip - prev_eip)); }
+  p = put_varint(p, value);
+
+  prev_instr = instr;
+  prev_addr = addr;
+  prev_eip = eip;
+  p_cur = p;
+  nr_record ++;
+  if (p_cur > p_limit) { submit_block(); }
+}
+
+static void close_mem_trace() {
+  if (closed) return;
+  closed = true;
+  mem_trace_on = false;
+  if (p_cur != block[cur]) { submit_block(); }
+
+  pthread_mutex_lock(&lock);
+  quit = true;
+  pthread_cond_broadcast(&cond);
+  pthread_mutex_unlock(&lock);
+  pthread_join(writer, NULL);
+  fclose(trace_fp);
+
+  Log("memory trace: %ld records, %ld bytes encoded, %ld bytes written",
+      nr_record, raw_bytes, file_bytes);
+}
+
+/* abort() skips the atexit() handlers, and it raises the signal again
+ * after the handler returns */
+static void abort_handler(int sig) {
+  signal(SIGABRT, SIG_DFL);
+  /* the writer can not join itself, and the blocks are lost then */
+  if (!pthread_equal(pthread_self(), writer)) { close_mem_trace(); }
+}
+
+void init_mem_trace(const char *file) {
+  if (file == NULL) return;
+
+  trace_fp = fopen(file, "wb");
+  Assert(trace_fp, "Can not open '%s'", file);
+
+  TraceHeader h = { .compress = TRACE_RAW, .block_size = BLOCK_SIZE };
+  memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+#ifdef HAS_ZSTD
+  h.compress = TRACE_ZSTD;
+#endif
+  int ret = fwrite(&h, sizeof(h), 1, trace_fp);
+  Assert(ret == 1, "Can not write '%s'", file);
+
+  int i;
+  for (i = 0; i < NR_BLOCK; i ++) {
+    block[i] = malloc(BLOCK_SIZE);
+    Assert(block[i], "Can not allocate the blocks of the memory trace");
+  }
+  start_block();
+
+  ret = pthread_create(&writer, NULL, writer_main, NULL);
+  Assert(ret == 0, "Can not create the writer thread of the memory trace");
+  atexit(close_mem_trace);
+  signal(SIGABRT, abort_handler);
+
+  mem_trace_on = true;
+  Log("Memory accesses are traced to %s%s", file, (h.compress == TRACE_ZSTD ? " (zstd)" : ""));
+}
+
+#endif
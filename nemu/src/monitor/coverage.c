@@ -0,0 +1,52 @@
+#include "nemu.h"
+#include "monitor/coverage.h"
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+
+/* The maps are shared memory, so that a fuzzer sees them while the guest
+ * is running, and nothing has to be saved when NEMU exits or aborts.
+ *   - With `-C FILE', FILE is created with the edge map followed by the
+ *     block map, and it is mapped into NEMU.
+ *   - Under AFL (__AFL_SHM_ID is set), the edge map is the shared memory
+ *     of AFL instead.
+ */
+
+NEMU_TLS uint8_t *cov_edge_map = NULL, *cov_block_map = NULL;
+NEMU_TLS uint32_t cov_prev = 0;
+
+void init_coverage(const char *file) {
+  uint8_t *edge_map = NULL;
+  const char *shm_id = getenv("__AFL_SHM_ID");
+  if (shm_id != NULL) {
+    edge_map = shmat(atoi(shm_id), NULL, 0);
+    Assert(edge_map != (void *)-1, "Can not attach the shared memory %s of AFL", shm_id);
+    Log("Coverage goes to the shared memory %s of AFL", shm_id);
+  }
+
+  if (file != NULL) {
+    int fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    Assert(fd >= 0, "Can not open '%s'", file);
+    int ret = ftruncate(fd, COV_MAP_SIZE * 2);
+    Assert(ret == 0, "Can not resize '%s'", file);
+    uint8_t *p = mmap(NULL, COV_MAP_SIZE * 2, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    Assert(p != MAP_FAILED, "Can not map '%s'", file);
+    close(fd);
+
+    if (edge_map == NULL) { edge_map = p; }
+    cov_block_map = p + COV_MAP_SIZE;
+    Log("Coverage goes to %s", file);
+  }
+  else if (edge_map != NULL) {
+    cov_block_map = calloc(COV_MAP_SIZE, 1);
+    Assert(cov_block_map, "Can not allocate the block map");
+  }
+
+  if (edge_map == NULL) return;
+  cov_edge_map = edge_map;
+
+  /* the entry is the first block */
+  cov_block(cpu.eip);
+}
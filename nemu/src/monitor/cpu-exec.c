@@ -1,7 +1,12 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
+#include "monitor/breakpoint.h"
 #include "monitor/expr.h"
+#include "cpu/perfcnt.h"
+#include "memory/cache.h"
+#include "cpu/branch.h"
+#include "cpu/intr.h"
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -10,18 +15,50 @@
  */
 #define MAX_INSTR_TO_PRINT 10
 
-int nemu_state = NEMU_STOP;
+NEMU_TLS int nemu_state = NEMU_STOP;
 
 void exec_wrapper(bool);
+void difftest_sync();
 
-static uint64_t g_nr_guest_instr = 0;
+static NEMU_TLS uint64_t g_nr_guest_instr = 0;
+NEMU_TLS PerfCnt perfcnt;
+
+/* the execution stops when eip reaches it, see cpu_exec_until() */
+static NEMU_TLS vaddr_t until_eip = 0;
+static NEMU_TLS bool until_eip_valid = false;
+static NEMU_TLS bool stopped_at_bp = false;
 
 void nr_guest_instr_add(uint32_t n) {
   g_nr_guest_instr += n;
 }
 
+uint64_t get_nr_guest_instr() {
+  return g_nr_guest_instr;
+}
+
+void set_nr_guest_instr(uint64_t n) {
+  g_nr_guest_instr = n;
+}
+
 void monitor_statistic() {
   Log("total guest instructions = %ld", g_nr_guest_instr);
+  Log("loads = %ld, stores = %ld, taken branches = %ld, interrupts = %ld",
+      perfcnt.load, perfcnt.store, perfcnt.branch_taken, perfcnt.intr);
+  intr_report();
+  mem_statistic();
+
+#ifdef OPCODE_PROFILE
+  void opcode_profile_report();
+  opcode_profile_report();
+#endif
+
+#ifdef CACHE_SIM
+  cache_report();
+#endif
+
+#ifdef BRANCH_PROF
+  branch_report();
+#endif
 }
 
 /* Simulate how the CPU works. */
@@ -33,8 +70,22 @@ void cpu_exec(uint64_t n) {
   nemu_state = NEMU_RUNNING;
 
   bool print_flag = n < MAX_INSTR_TO_PRINT;
+  /* Like eflags.RF, a breakpoint does not stop the instruction just
+   * executed again. This covers the resumption from the breakpoint where
+   * the last execution stopped, and repeated string instructions. */
+  vaddr_t last_eip = cpu.eip;
+  bool rf = stopped_at_bp;
+  stopped_at_bp = false;
 
   for (; n > 0; n --) {
+    if (bp_check(cpu.eip) && !(rf && cpu.eip == last_eip)) {
+      printf("Breakpoint at 0x%08x\n", cpu.eip);
+      stopped_at_bp = true;
+      break;
+    }
+    last_eip = cpu.eip;
+    rf = true;
+
     /* Execute one instruction, including instruction fetch,
      * instruction decode, and the actual execution. */
     exec_wrapper(print_flag);
@@ -43,6 +94,7 @@ void cpu_exec(uint64_t n) {
 #ifdef DEBUG
     /* TODO: check watchpoints here. */
     WP* head = wp_get_head();
+    bool wp_hit = false;
     while (head) {
         bool success = true;
         uint32_t new_value = expr(head->exp, &success);
@@ -54,10 +106,13 @@ void cpu_exec(uint64_t n) {
                 head->old_value = new_value;
             }
             nemu_state = NEMU_STOP;
-            return;
+            wp_hit = true;
+            break;
         }
         head = head->next;
     }
+    /* leave the loop, so that difftest and the serial are synced below */
+    if (wp_hit) { break; }
 #endif
 
 #ifdef HAS_IOE
@@ -66,10 +121,20 @@ void cpu_exec(uint64_t n) {
 #endif
 
     if (nemu_state != NEMU_RUNNING) {
+#ifdef DIFF_TEST
+      difftest_sync();
+#endif
+#ifdef HAS_IOE
+      extern void serial_flush();
+      serial_flush();
+#endif
       if (nemu_state == NEMU_END) {
+#ifndef _SHARE
+        /* the users of the library report it themselves */
         printflog("\33[1;31mnemu: HIT %s TRAP\33[0m at eip = 0x%08x\n\n",
             (cpu.eax == 0 ? "GOOD" : "BAD"), cpu.eip - 1);
         monitor_statistic();
+#endif
         return;
       }
       else if (nemu_state == NEMU_ABORT) {
@@ -77,7 +142,30 @@ void cpu_exec(uint64_t n) {
         return;
       }
     }
+
+    if (until_eip_valid && cpu.eip == until_eip) { break; }
   }
 
+#ifdef HAS_IOE
+  extern void serial_flush();
+  serial_flush();
+#endif
+
+#ifdef DIFF_TEST
+  difftest_sync();
+#endif
+
   if (nemu_state == NEMU_RUNNING) { nemu_state = NEMU_STOP; }
 }
+
+/* Execute at most `n' instructions, and stop before the one at `eip'. */
+void cpu_exec_until(vaddr_t eip, uint64_t n) {
+  until_eip = eip;
+  until_eip_valid = true;
+  cpu_exec(n);
+  until_eip_valid = false;
+}
+
+bool cpu_stopped_at_bp() {
+  return stopped_at_bp;
+}
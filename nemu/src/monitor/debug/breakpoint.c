@@ -0,0 +1,110 @@
+#include "monitor/breakpoint.h"
+#include <stdlib.h>
+
+#define NR_PAGE (1u << (32 - BP_PAGE_SHIFT))
+#define INIT_CAP 64
+
+int nr_bp = 0;
+uint8_t bp_page_map[NR_PAGE / 8];
+
+/* an open addressing hash table with linear probing, and a slot is
+ * empty if it is not marked in `used' */
+static vaddr_t *slot = NULL;
+static bool *used = NULL;
+static uint32_t cap = 0;
+
+static inline uint32_t hash(vaddr_t addr) {
+  return (addr * 2654435761u) & (cap - 1);
+}
+
+static inline void page_mark(vaddr_t addr, bool mark) {
+  uint32_t page = addr >> BP_PAGE_SHIFT;
+  if (mark) { bp_page_map[page >> 3] |= (1 << (page & 7)); }
+  else { bp_page_map[page >> 3] &= ~(1 << (page & 7)); }
+}
+
+static void insert(vaddr_t addr) {
+  uint32_t i;
+  for (i = hash(addr); used[i]; i = (i + 1) & (cap - 1));
+  slot[i] = addr;
+  used[i] = true;
+}
+
+static void resize(uint32_t new_cap) {
+  vaddr_t *old_slot = slot;
+  bool *old_used = used;
+  uint32_t old_cap = cap, i;
+
+  cap = new_cap;
+  slot = malloc(sizeof(vaddr_t) * cap);
+  used = calloc(cap, sizeof(bool));
+  Assert(slot && used, "Can not allocate the breakpoint table");
+  for (i = 0; i < old_cap; i ++) {
+    if (old_used[i]) { insert(old_slot[i]); }
+  }
+  free(old_slot);
+  free(old_used);
+}
+
+/* return the slot of `addr', or -1 if it is not found */
+static int lookup(vaddr_t addr) {
+  if (cap == 0) return -1;
+  uint32_t i;
+  for (i = hash(addr); used[i]; i = (i + 1) & (cap - 1)) {
+    if (slot[i] == addr) return i;
+  }
+  return -1;
+}
+
+bool bp_find(vaddr_t addr) {
+  return lookup(addr) != -1;
+}
+
+bool bp_add(vaddr_t addr) {
+  if (bp_find(addr)) return false;
+  /* keep the load factor below 1/2 */
+  if ((nr_bp + 1) * 2 > cap) { resize(cap == 0 ? INIT_CAP : cap * 2); }
+  insert(addr);
+  page_mark(addr, true);
+  nr_bp ++;
+  return true;
+}
+
+bool bp_del(vaddr_t addr) {
+  int idx = lookup(addr);
+  if (idx == -1) return false;
+
+  /* re-insert the rest of the cluster to fill the hole */
+  uint32_t i = idx;
+  used[i] = false;
+  for (i = (i + 1) & (cap - 1); used[i]; i = (i + 1) & (cap - 1)) {
+    used[i] = false;
+    insert(slot[i]);
+  }
+  nr_bp --;
+
+  /* the page is still marked if it has other breakpoints */
+  bool others = false;
+  for (i = 0; i < cap && !others; i ++) {
+    others = used[i] && (slot[i] >> BP_PAGE_SHIFT) == (addr >> BP_PAGE_SHIFT);
+  }
+  page_mark(addr, others);
+  return true;
+}
+
+static int addr_cmp(const void *a, const void *b) {
+  vaddr_t x = *(vaddr_t *)a, y = *(vaddr_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* store at most `max' breakpoints into `addrs' in ascending order,
+ * and return the number of them */
+int bp_list(vaddr_t *addrs, int max) {
+  uint32_t i;
+  int n = 0;
+  for (i = 0; i < cap && n < max; i ++) {
+    if (used[i]) { addrs[n ++] = slot[i]; }
+  }
+  qsort(addrs, n, sizeof(vaddr_t), addr_cmp);
+  return n;
+}
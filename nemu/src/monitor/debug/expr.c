@@ -7,6 +7,11 @@
 #include <regex.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <time.h>
+
+/* the trace of the evaluation is turned off in the batch mode */
+static bool expr_quiet = false;
+#define expr_log(...) do { if (!expr_quiet) Log(__VA_ARGS__); } while (0)
 
 enum {
   TK_NOTYPE = 256, TK_EQ, TK_DNUM, TK_HNUM, TK_REG, TK_DREF, TK_NEQ, TK_LAND,
@@ -89,7 +94,7 @@ static bool make_token(char *e) {
         char *substr_start = e + position;
         int substr_len = pmatch.rm_eo;
 
-        Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
+        expr_log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
             i, rules[i].regex, position, substr_len, substr_len, substr_start);
         position += substr_len;
 
@@ -115,13 +120,13 @@ static bool make_token(char *e) {
             }
             strncpy(tokens[nr_token].str, substr_start, substr_len);
             tokens[nr_token++].str[substr_len] = '\0';
-            Log("Number token %d: %s", nr_token - 1, tokens[nr_token - 1].str);
+            expr_log("Number token %d: %s", nr_token - 1, tokens[nr_token - 1].str);
             break;
           case TK_REG:
             tokens[nr_token].type = rules[i].token_type;
             strncpy(tokens[nr_token].str, substr_start + 1, substr_len - 1);
             tokens[nr_token++].str[substr_len] = '\0';
-            Log("Reg token %d: %s", nr_token - 1, tokens[nr_token - 1].str);
+            expr_log("Reg token %d: %s", nr_token - 1, tokens[nr_token - 1].str);
             break;
           default: TODO();
         }
@@ -225,7 +230,7 @@ static int find_main_op(int p, int q) {
         }
     }
     if (ret == -1)
-        Log("find_main_op() failed");
+        expr_log("find_main_op() failed");
     return ret;
 }
 
@@ -291,7 +296,7 @@ static uint32_t eval(int p, int q, bool *success) {
             else if (strcmp(tokens[p].str, "bh") == 0)
                 return reg_b(R_BH);
             else {
-                Log("Unrecognized reg name");
+                expr_log("Unrecognized reg name");
                 *success = false;
                 return 0;
             }
@@ -305,22 +310,22 @@ static uint32_t eval(int p, int q, bool *success) {
         return eval(p + 1, q - 1, success);
     }
     else {
-        Log("p: %d, q: %d", p, q);
+        expr_log("p: %d, q: %d", p, q);
         int op = find_main_op(p, q);
         if (op == -1) {
             *success = false;
             return 0;
         }
-        Log("op: %d", op);
+        expr_log("op: %d", op);
         if (tokens[op].type != TK_DREF) {
             uint32_t val1 = eval(p, op - 1, success);
             if (!(*success))
                 return 0;
-            Log("val1: %u", val1);
+            expr_log("val1: %u", val1);
             uint32_t val2 = eval(op + 1, q, success);
             if (!(*success))
                 return 0;
-            Log("val2: %u", val2);
+            expr_log("val2: %u", val2);
             switch (tokens[op].type) {
                 case '+': 
                     return val1 + val2;
@@ -330,7 +335,7 @@ static uint32_t eval(int p, int q, bool *success) {
                     return val1 * val2;
                 case '/':
                     if (val2 == 0) {
-                        printf("Divided by 0!\n");
+                        expr_log("Divided by 0!");
                         *success = false;
                         return 0;
                     }
@@ -357,9 +362,9 @@ static uint32_t eval(int p, int q, bool *success) {
             // Log("DREF");
             uint32_t val = eval(op + 1, q, success);
             if (!(*success)) return 0;
-            Log("val: %u", val);
-            if (val < 0 || val >= (128 * 1024 * 1024)) {
-                Log("mem[%u] out of bound", val);
+            expr_log("val: %u", val);
+            if (val < 0 || val >= pmem_size) {
+                expr_log("mem[%u] out of bound", val);
                 *success = false;
                 return 0;
             }
@@ -367,3 +372,50 @@ static uint32_t eval(int p, int q, bool *success) {
         }
     }
 }
+
+/* Evaluate the expressions in `file', one per line in the form of
+ * "RESULT EXPR" as generated by tools/gen-expr, and report the
+ * mismatches and the throughput. Return the number of mismatches.
+ */
+int expr_batch(const char *file) {
+  FILE *fp = fopen(file, "r");
+  Assert(fp, "Can not open '%s'", file);
+
+  char *line = NULL;
+  size_t cap = 0;
+  uint64_t nr_expr = 0, nr_fail = 0, nr_mismatch = 0;
+  struct timespec t0, t1;
+  double sec = 0;
+
+  expr_quiet = true;
+  while (getline(&line, &cap, fp) != -1) {
+    uint32_t ref;
+    int pos;
+    if (sscanf(line, "%u %n", &ref, &pos) != 1) continue;
+    char *e = line + pos;
+    e[strcspn(e, "\n")] = '\0';
+
+    bool success = true;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint32_t val = expr(e, &success);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    sec += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    nr_expr ++;
+
+    if (!success) {
+      nr_fail ++;
+      printf("failed: %s\n", e);
+    }
+    else if (val != ref) {
+      nr_mismatch ++;
+      printf("mismatch: expected %u, got %u: %s\n", ref, val, e);
+    }
+  }
+  expr_quiet = false;
+  free(line);
+  fclose(fp);
+
+  printf("%lu expressions, %lu mismatches, %lu failed, %.0f evals/s\n",
+      nr_expr, nr_mismatch, nr_fail, (sec > 0 ? nr_expr / sec : 0));
+  return nr_mismatch;
+}
@@ -1,13 +1,22 @@
 #include "monitor/monitor.h"
 #include "monitor/expr.h"
 #include "monitor/watchpoint.h"
+#include "monitor/breakpoint.h"
+#include "monitor/elf.h"
 #include "nemu.h"
 
 #include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 
 void cpu_exec(uint64_t);
+void cpu_exec_until(vaddr_t, uint64_t);
+bool gdb_enabled();
+void gdb_mainloop();
+
+static FILE *script_fp = NULL;
 
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 char* rl_gets() {
@@ -44,6 +53,11 @@ static int cmd_x(char *args);
 static int cmd_p(char *args);
 static int cmd_w(char *args);
 static int cmd_d(char *args);
+static int cmd_until(char *args);
+static int cmd_b(char *args);
+static int cmd_bd(char *args);
+static int cmd_count(char *args);
+static int cmd_time(char *args);
 
 static struct {
   char *name;
@@ -53,12 +67,17 @@ static struct {
   { "help", "Display informations about all supported commands", cmd_help },
   { "c", "Continue the execution of the program", cmd_c },
   { "q", "Exit NEMU", cmd_q },
-  { "si", "Instruction level single step", cmd_si },
+  { "si", "Instruction level single step, si [N] (e.g. 100, 0x100, 1e6)", cmd_si },
   { "info", "Print program status", cmd_info },
   { "x", "Read from the memory of the current target program", cmd_x },
   { "p", "Print value of expression EXP", cmd_p },
   { "w", "Set a watchpoint for an expression", cmd_w },
   { "d", "Delete a watchpoint", cmd_d },
+  { "b", "Set a breakpoint at the address or symbol", cmd_b },
+  { "bd", "Delete the breakpoint at the address or symbol", cmd_bd },
+  { "until", "Continue the execution until eip reaches the address or symbol", cmd_until },
+  { "count", "Continue the execution until N instructions are executed in total (e.g. 1e9)", cmd_count },
+  { "time", "Execute a command and report the time and instructions it takes", cmd_time },
 
   /* TODO: Add more commands */
 
@@ -89,16 +108,37 @@ static int cmd_help(char *args) {
   return 0;
 }
 
+/* Parse a positive instruction count, 0 if it is invalid. A decimal
+ * count may have an exponent, e.g. 1e9. */
+static uint64_t parse_count(const char *arg) {
+    char *end;
+    uint64_t n = strtoull(arg, &end, 0);
+    if (arg[0] == '-' || end == arg) {
+        return 0;
+    }
+    if ((*end == 'e' || *end == 'E') && isdigit(end[1])) {
+        unsigned long exp = strtoul(end + 1, &end, 10);
+        for (; exp > 0 && n != 0; exp --) {
+            if (n > UINT64_MAX / 10) return 0;
+            n *= 10;
+        }
+    }
+    if (*end != '\0') {
+        return 0;
+    }
+    return n;
+}
+
 static int cmd_si(char *args) {
     char *arg = strtok(NULL, " ");
-    int n;
+    uint64_t n;
     
     if (arg == NULL) {
         n = 1;
     }
     else {
-        n = atoi(arg);
-        if (n <= 0) {
+        n = parse_count(arg);
+        if (n == 0) {
             printf("The 1st argument should be a postive integer rather than '%s'\n", arg);
             return 0;
         }
@@ -111,7 +151,7 @@ static int cmd_info(char *args) {
     char *arg = strtok(NULL, " ");
 
     if (arg == NULL) {
-        printf("Missing subcommand.\nNow supports 'r'.\n");
+        printf("Missing subcommand.\nNow supports 'r', 'w' and 'b'.\n");
         return 0;
     }
     else {
@@ -136,6 +176,15 @@ static int cmd_info(char *args) {
                 printf("Watchpoint %d %s=%u\n", i, head->exp, head->old_value);
             }
         }
+        else if (strcmp(arg, "b") == 0) {
+            vaddr_t *addrs = malloc(sizeof(vaddr_t) * nr_bp);
+            int n = bp_list(addrs, nr_bp);
+            for (int i = 0; i < n; i++) {
+                const char *name = elf_func_name(addrs[i]);
+                printf("Breakpoint 0x%08x %s\n", addrs[i], (name ? name : ""));
+            }
+            free(addrs);
+        }
         else {
             printf("Unsupported command '%s'\n", arg);
         }
@@ -166,7 +215,7 @@ static int cmd_x(char *args) {
     else {
         // TODO: modify it to expr eval
         esp = strtol(arg2, NULL, 16);
-        if (esp < 0 || esp >= (128 * 1024 * 1024)) {
+        if (esp < 0 || esp >= pmem_size) {
             printf("Wrong memory address!\n");
             return 0;
         }
@@ -222,18 +271,88 @@ static int cmd_d(char *args) {
     return 0;
 }
 
-void ui_mainloop(int is_batch_mode) {
-  if (is_batch_mode) {
-    cmd_c(NULL);
-    return;
-  }
+/* an address is given as an ELF symbol or an expression */
+static bool parse_addr(char *args, vaddr_t *addr) {
+    if (args == NULL) {
+        printf("Missing address.\n");
+        return false;
+    }
+    if (!elf_sym_addr(args, addr)) {
+        bool success = true;
+        *addr = expr(args, &success);
+        if (!success) {
+            printf("Error in '%s'\n", args);
+            return false;
+        }
+    }
+    return true;
+}
 
-  for (char *str; (str = rl_gets()) != NULL; ) {
+static int cmd_until(char *args) {
+    vaddr_t eip;
+    if (parse_addr(args, &eip)) {
+        cpu_exec_until(eip, -1);
+    }
+    return 0;
+}
+
+static int cmd_b(char *args) {
+    vaddr_t addr;
+    if (parse_addr(args, &addr) && !bp_add(addr)) {
+        printf("Breakpoint at 0x%08x already exists\n", addr);
+    }
+    return 0;
+}
+
+static int cmd_bd(char *args) {
+    vaddr_t addr;
+    if (parse_addr(args, &addr) && !bp_del(addr)) {
+        printf("No breakpoint at 0x%08x\n", addr);
+    }
+    return 0;
+}
+
+static int cmd_count(char *args) {
+    char *arg = strtok(NULL, " ");
+    uint64_t n = (arg == NULL ? 0 : parse_count(arg));
+    if (n == 0) {
+        printf("The 1st argument should be a postive integer\n");
+        return 0;
+    }
+    uint64_t now = get_nr_guest_instr();
+    if (n > now) {
+        cpu_exec(n - now);
+    }
+    return 0;
+}
+
+static int ui_exec(char *str);
+
+static int cmd_time(char *args) {
+    if (args == NULL) {
+        printf("Missing command.\n");
+        return 0;
+    }
+    struct timespec t0, t1;
+    uint64_t nr_instr = get_nr_guest_instr();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int ret = ui_exec(args);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    nr_instr = get_nr_guest_instr() - nr_instr;
+
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("time: %.6f s, %lu instructions, %.2f MIPS\n",
+            sec, nr_instr, (sec > 0 ? nr_instr / sec / 1e6 : 0));
+    return ret;
+}
+
+/* Execute a command line. Return a negative value to exit NEMU. */
+static int ui_exec(char *str) {
     char *str_end = str + strlen(str);
 
     /* extract the first token as the command */
     char *cmd = strtok(str, " ");
-    if (cmd == NULL) { continue; }
+    if (cmd == NULL || cmd[0] == '#') { return 0; }
 
     /* treat the remaining string as the arguments,
      * which may need further parsing
@@ -251,11 +370,51 @@ void ui_mainloop(int is_batch_mode) {
     int i;
     for (i = 0; i < NR_CMD; i ++) {
       if (strcmp(cmd, cmd_table[i].name) == 0) {
-        if (cmd_table[i].handler(args) < 0) { return; }
-        break;
+        return cmd_table[i].handler(args);
       }
     }
 
-    if (i == NR_CMD) { printf("Unknown command '%s'\n", cmd); }
+    printf("Unknown command '%s'\n", cmd);
+    return 0;
+}
+
+void init_script(const char *file) {
+  if (file == NULL) return;
+  script_fp = fopen(file, "r");
+  Assert(script_fp, "Can not open '%s'", file);
+}
+
+/* Commands in the script are executed one per line, and lines
+ * starting with `#' are comments. NEMU exits at the end of the script.
+ */
+static void script_mainloop() {
+  char line[1024];
+  while (fgets(line, sizeof(line), script_fp) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0' || line[0] == '#') { continue; }
+    printf("(nemu) %s\n", line);
+    if (ui_exec(line) < 0) { break; }
+  }
+  fclose(script_fp);
+}
+
+void ui_mainloop(int is_batch_mode) {
+  if (gdb_enabled()) {
+    gdb_mainloop();
+    return;
+  }
+
+  if (script_fp != NULL) {
+    script_mainloop();
+    return;
+  }
+
+  if (is_batch_mode) {
+    cmd_c(NULL);
+    return;
+  }
+
+  for (char *str; (str = rl_gets()) != NULL; ) {
+    if (ui_exec(str) < 0) { return; }
   }
 }
@@ -3,11 +3,17 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
 #include "diff-test.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 static void (*ref_difftest_memcpy_from_dut)(paddr_t dest, void *src, size_t n);
 static void (*ref_difftest_getregs)(void *c);
 static void (*ref_difftest_setregs)(const void *c);
 static void (*ref_difftest_exec)(uint64_t n);
+static void (*ref_difftest_init)(void);
 
 static bool is_skip_ref;
 static bool is_skip_dut;
@@ -15,12 +21,207 @@ static bool is_skip_dut;
 void difftest_skip_ref() { is_skip_ref = true; }
 void difftest_skip_dut() { is_skip_dut = true; }
 
-void init_difftest(char *ref_so_file, long img_size) {
+static bool regs_equal(const CPU_state *ref, const CPU_state *dut) {
+  return memcmp(ref, dut, DIFFTEST_REG_SIZE) == 0;
+}
+
+static void report_diff(const CPU_state *ref, const CPU_state *dut, uint64_t idx, vaddr_t eip) {
+  printflog("\33[1;31mdifftest: diverged at instruction #%ld (eip = 0x%08x)\33[0m\n", idx, eip);
+  int i;
+  for (i = 0; i < 8; i ++) {
+    if (ref->gpr[i]._32 != dut->gpr[i]._32) {
+      printflog("  %s: ref = 0x%08x, dut = 0x%08x\n", regsl[i], ref->gpr[i]._32, dut->gpr[i]._32);
+    }
+  }
+  if (ref->eip != dut->eip) {
+    printflog("  eip: ref = 0x%08x, dut = 0x%08x\n", ref->eip, dut->eip);
+  }
+}
+
+/* In the pipelined mode (-a), the reference runs on a checker thread.
+ * For each instruction the DUT pushes its state into a single-producer
+ * single-consumer ring, and the checker steps the reference and compares.
+ * The DUT is only stopped by a full ring, and it learns about a
+ * divergence some instructions later, but the report has the exact
+ * instruction. The ring is drained when cpu_exec() returns.
+ *
+ * The reference is driven only by the checker thread, since nemu-so
+ * keeps its state in thread-local storage.
+ */
+
+enum { REC_STEP, REC_SKIP_REF, REC_SKIP_DUT, REC_MEM };
+
+typedef struct {
+  int kind;
+  uint64_t idx;       // index of the instruction
+  vaddr_t eip;        // eip of the instruction
+  CPU_state regs;     // DUT state after the instruction
+  paddr_t addr;       // REC_MEM: guest memory written by a device
+  uint32_t len;
+  void *data;
+} DiffRecord;
+
+#define RING_SIZE 4096    // power of 2
+#define SPIN_LIMIT 1024
+
+static DiffRecord ring[RING_SIZE];
+/* `head' is only written by the DUT and `tail' by the checker */
+static atomic_uint_fast64_t ring_head, ring_tail;
+static uint64_t head, tail_cache;
+
+static bool async_mode = false;
+static paddr_t async_img_start;
+static long async_img_size;
+static atomic_bool checker_ready;
+static atomic_bool diverged;
+static bool diverge_reported = false;
+static DiffRecord diverge_rec;
+static CPU_state diverge_ref;
+
+static void wait_a_while(int *spin) {
+  if (*spin < SPIN_LIMIT) { (*spin) ++; sched_yield(); }
+  else { usleep(100); }
+}
+
+static void check_record(DiffRecord *r) {
+  CPU_state ref_r;
+  switch (r->kind) {
+    case REC_STEP:
+      ref_difftest_exec(1);
+      ref_difftest_getregs(&ref_r);
+      if (!regs_equal(&ref_r, &r->regs)) {
+        diverge_rec = *r;
+        diverge_ref = ref_r;
+        atomic_store_explicit(&diverged, true, memory_order_release);
+      }
+      break;
+    case REC_SKIP_REF: ref_difftest_setregs(&r->regs); break;
+    case REC_MEM: ref_difftest_memcpy_from_dut(r->addr, r->data, r->len); break;
+    default: break;
+  }
+}
+
+static void *checker_main(void *arg) {
+  ref_difftest_init();
+  ref_difftest_memcpy_from_dut(async_img_start, guest_to_host(async_img_start), async_img_size);
+  ref_difftest_setregs(arg);
+  atomic_store_explicit(&checker_ready, true, memory_order_release);
+
+  uint64_t tail = 0;
+  int spin = 0;
+  while (true) {
+    uint64_t h = atomic_load_explicit(&ring_head, memory_order_acquire);
+    if (h == tail) {
+      wait_a_while(&spin);
+      continue;
+    }
+    spin = 0;
+    for (; tail != h; tail ++) {
+      DiffRecord *r = &ring[tail & (RING_SIZE - 1)];
+      /* after a divergence the records are only drained */
+      if (!atomic_load_explicit(&diverged, memory_order_relaxed)) { check_record(r); }
+      if (r->kind == REC_MEM) { free(r->data); }
+      atomic_store_explicit(&ring_tail, tail + 1, memory_order_release);
+    }
+  }
+  return NULL;
+}
+
+static DiffRecord *ring_alloc() {
+  int spin = 0;
+  while (head - tail_cache == RING_SIZE) {
+    tail_cache = atomic_load_explicit(&ring_tail, memory_order_acquire);
+    if (head - tail_cache == RING_SIZE) { wait_a_while(&spin); }
+  }
+  return &ring[head & (RING_SIZE - 1)];
+}
+
+static void ring_push() {
+  head ++;
+  atomic_store_explicit(&ring_head, head, memory_order_release);
+}
+
+static void async_step(vaddr_t eip) {
+  if (atomic_load_explicit(&diverged, memory_order_acquire)) {
+    nemu_state = NEMU_ABORT;
+    return;
+  }
+
+  DiffRecord *r = ring_alloc();
+  r->kind = (is_skip_dut ? REC_SKIP_DUT : (is_skip_ref ? REC_SKIP_REF : REC_STEP));
+  r->idx = get_nr_guest_instr();
+  r->eip = eip;
+  r->regs = cpu;
+  ring_push();
+  is_skip_dut = is_skip_ref = false;
+}
+
+/* Wait for the checker to catch up, and report the divergence if any. */
+void difftest_sync() {
+  if (!async_mode) return;
+
+  int spin = 0;
+  while (atomic_load_explicit(&ring_tail, memory_order_acquire) != head) {
+    wait_a_while(&spin);
+  }
+  tail_cache = head;
+
+  if (atomic_load_explicit(&diverged, memory_order_acquire)) {
+    if (!diverge_reported) {
+      report_diff(&diverge_ref, &diverge_rec.regs, diverge_rec.idx, diverge_rec.eip);
+      Log("the DUT ran %ld instructions ahead", get_nr_guest_instr() - diverge_rec.idx);
+      diverge_reported = true;
+    }
+    nemu_state = NEMU_ABORT;
+  }
+}
+
+/* Guest memory [addr, addr + len) is written by a device of the DUT, which
+ * the reference can not reproduce. */
+void difftest_dut_write(paddr_t addr, uint32_t len) {
+  if (!async_mode) {
+    ref_difftest_memcpy_from_dut(addr, guest_to_host(addr), len);
+    return;
+  }
+
+  /* the guest may change the memory before the checker sees it */
+  void *data = malloc(len);
+  Assert(data, "Can not allocate the memory log of difftest");
+  memcpy(data, guest_to_host(addr), len);
+
+  DiffRecord *r = ring_alloc();
+  r->kind = REC_MEM;
+  r->idx = get_nr_guest_instr();
+  r->addr = addr;
+  r->len = len;
+  r->data = data;
+  ring_push();
+}
+
+/* The registers of the DUT are changed between two instructions, e.g. by
+ * an interrupt, which the reference can not reproduce. */
+void difftest_dut_regs() {
+  if (!async_mode) {
+    ref_difftest_setregs(&cpu);
+    return;
+  }
+
+  DiffRecord *r = ring_alloc();
+  r->kind = REC_SKIP_REF;
+  r->idx = get_nr_guest_instr();
+  r->eip = cpu.eip;
+  r->regs = cpu;
+  ring_push();
+}
+
+/* The image occupies [img_start, img_start + img_size). */
+void init_difftest(char *ref_so_file, paddr_t img_start, long img_size, bool async) {
 #ifndef DIFF_TEST
   return;
 #endif
 
   assert(ref_so_file != NULL);
+  string_single_iter = true;
 
   void *handle;
   handle = dlopen(ref_so_file, RTLD_LAZY | RTLD_DEEPBIND);
@@ -38,22 +239,41 @@ void init_difftest(char *ref_so_file, long img_size) {
   ref_difftest_exec = dlsym(handle, "difftest_exec");
   assert(ref_difftest_exec);
 
-  void (*ref_difftest_init)(void) = dlsym(handle, "difftest_init");
+  ref_difftest_init = dlsym(handle, "difftest_init");
   assert(ref_difftest_init);
 
-  Log("Differential testing: \33[1;32m%s\33[0m", "ON");
+  Log("Differential testing: \33[1;32m%s\33[0m", (async ? "ON (pipelined)" : "ON"));
   Log("The result of every instruction will be compared with %s. "
       "This will help you a lot for debugging, but also significantly reduce the performance. "
       "If it is not necessary, you can turn it off in include/common.h.", ref_so_file);
 
+  if (async) {
+    async_mode = true;
+    async_img_start = img_start;
+    async_img_size = img_size;
+    pthread_t checker;
+    int ret = pthread_create(&checker, NULL, checker_main, &cpu);
+    Assert(ret == 0, "Can not create the checker thread of difftest");
+    pthread_detach(checker);
+
+    int spin = 0;
+    while (!atomic_load_explicit(&checker_ready, memory_order_acquire)) { wait_a_while(&spin); }
+    return;
+  }
+
   ref_difftest_init();
-  ref_difftest_memcpy_from_dut(ENTRY_START, guest_to_host(ENTRY_START), img_size);
+  ref_difftest_memcpy_from_dut(img_start, guest_to_host(img_start), img_size);
   ref_difftest_setregs(&cpu);
 }
 
 void difftest_step(uint32_t eip) {
   CPU_state ref_r;
 
+  if (async_mode) {
+    async_step(eip);
+    return;
+  }
+
   if (is_skip_dut) {
     is_skip_dut = false;
     return;
@@ -69,7 +289,8 @@ void difftest_step(uint32_t eip) {
   ref_difftest_exec(1);
   ref_difftest_getregs(&ref_r);
 
-  // TODO: Check the registers state with the reference design.
-  // Set `nemu_state` to `NEMU_ABORT` if they are not the same.
-  TODO();
+  if (!regs_equal(&ref_r, &cpu)) {
+    report_diff(&ref_r, &cpu, get_nr_guest_instr(), eip);
+    nemu_state = NEMU_ABORT;
+  }
 }
@@ -2,5 +2,11 @@
 #define __DIFF_TEST_H__
 
 #define DIFFTEST_REG_SIZE (sizeof(uint32_t) * 9) // GRPs + EIP
+/* difftest_setregs() also copies eflags and cs, in the order of the `g'
+ * packet of gdb. idtr can not be copied, the reference executes lidt. */
+#define DIFFTEST_SETREG_SIZE (sizeof(uint32_t) * 11)
+
+/* both sides execute one iteration of a string instruction per step */
+extern NEMU_TLS bool string_single_iter;
 
 #endif
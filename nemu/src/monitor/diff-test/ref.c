@@ -1,4 +1,5 @@
 #include "nemu.h"
+#include <stddef.h>
 #include "diff-test.h"
 
 void cpu_exec(uint64_t);
@@ -11,8 +12,12 @@ void difftest_getregs(void *r) {
   memcpy(r, &cpu, DIFFTEST_REG_SIZE);
 }
 
+/* eflags and cs follow eip, as in the `g' packet of gdb */
+_Static_assert(offsetof(CPU_state, cs) + sizeof(rtlreg_t) == DIFFTEST_SETREG_SIZE,
+    "CPU_state does not match the register layout of difftest_setregs()");
+
 void difftest_setregs(const void *r) {
-  memcpy(&cpu, r, DIFFTEST_REG_SIZE);
+  memcpy(&cpu, r, DIFFTEST_SETREG_SIZE);
 }
 
 void difftest_exec(uint64_t n) {
@@ -20,4 +25,6 @@ void difftest_exec(uint64_t n) {
 }
 
 void difftest_init(void) {
+  init_mem(0, PMEM_HUGE_NONE);
+  string_single_iter = true;
 }
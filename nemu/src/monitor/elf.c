@@ -0,0 +1,220 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/elf.h"
+#include <elf.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PAGE_SIZE 4096
+#define PAGE_DOWN(a) ((a) & ~(PAGE_SIZE - 1))
+#define PAGE_UP(a) PAGE_DOWN((a) + PAGE_SIZE - 1)
+
+typedef struct Symbol {
+  vaddr_t addr;
+  uint32_t size;
+  bool is_func;
+  const char *name;
+} Symbol;
+
+NEMU_TLS SymTab symtab;
+
+void free_symtab(SymTab *t) {
+  free(t->syms);
+  free(t->strtab);
+  t->syms = NULL;
+  t->strtab = NULL;
+  t->nr_sym = 0;
+}
+
+bool is_elf(const char *file) {
+  unsigned char ident[SELFMAG];
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) return false;
+  bool ret = (fread(ident, SELFMAG, 1, fp) == 1 && memcmp(ident, ELFMAG, SELFMAG) == 0);
+  fclose(fp);
+  return ret;
+}
+
+static bool read_at(int fd, void *buf, size_t len, off_t off) {
+  ssize_t ret = pread(fd, buf, len, off);
+  if (ret != len) {
+    Log("Can not read %zu bytes at offset %ld of the ELF file", len, (long)off);
+    return false;
+  }
+  return true;
+}
+
+/* Pages which are fully covered by the file contents of the segment are
+ * mapped copy-on-write from the file, so that only the pages touched by
+ * the guest are read in. The partial pages at both ends are copied, since
+ * they may be shared with other segments.
+ */
+static bool load_segment(int fd, off_t file_size, Elf32_Phdr *ph) {
+  paddr_t start = ph->p_paddr, end = ph->p_paddr + ph->p_filesz;
+  if ((uint64_t)ph->p_paddr + ph->p_memsz > pmem_size || ph->p_filesz > ph->p_memsz) {
+    Log("segment [0x%08x, 0x%08x) is out of physical memory", ph->p_paddr, ph->p_paddr + ph->p_memsz);
+    return false;
+  }
+  /* a mapping beyond the end of the file faults when it is touched */
+  if ((uint64_t)ph->p_offset + ph->p_filesz > file_size) {
+    Log("segment [0x%08x, 0x%08x) is truncated", ph->p_paddr, ph->p_paddr + ph->p_memsz);
+    return false;
+  }
+
+  paddr_t map_start = PAGE_UP(start), map_end = PAGE_DOWN(end);
+  bool can_map = ((start - ph->p_offset) % PAGE_SIZE == 0) && map_start < map_end;
+  if (can_map) {
+    /* this fails if the physical memory is backed by hugetlbfs */
+    void *p = mmap(guest_to_host(map_start), map_end - map_start, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_FIXED, fd, ph->p_offset + (map_start - start));
+    can_map = (p != MAP_FAILED);
+  }
+  /* the rest of the segment (.bss) is already zero */
+  if (!can_map) {
+    return read_at(fd, guest_to_host(start), ph->p_filesz, ph->p_offset);
+  }
+  return read_at(fd, guest_to_host(start), map_start - start, ph->p_offset) &&
+    read_at(fd, guest_to_host(map_end), end - map_end, ph->p_offset + (map_end - start));
+}
+
+static int sym_cmp(const void *a, const void *b) {
+  vaddr_t x = ((Symbol *)a)->addr, y = ((Symbol *)b)->addr;
+  return (x > y) - (x < y);
+}
+
+/* The symbols of the image loaded before are dropped, even if this fails. */
+static bool load_symtab(int fd, Elf32_Ehdr *eh) {
+  free_symtab(&symtab);
+  if (eh->e_shnum == 0) return true;
+  if (eh->e_shentsize != sizeof(Elf32_Shdr)) return false;
+
+  Elf32_Shdr *sh = malloc(sizeof(Elf32_Shdr) * eh->e_shnum);
+  bool ok = read_at(fd, sh, sizeof(Elf32_Shdr) * eh->e_shnum, eh->e_shoff);
+
+  int i;
+  for (i = 0; ok && i < eh->e_shnum; i ++) {
+    if (sh[i].sh_type != SHT_SYMTAB) continue;
+    if (sh[i].sh_link >= eh->e_shnum) { ok = false; break; }
+
+    Elf32_Shdr *str_sh = &sh[sh[i].sh_link];
+    /* terminate the last name even if the file does not */
+    char *strtab = calloc((size_t)str_sh->sh_size + 1, 1);
+    int n = sh[i].sh_size / sizeof(Elf32_Sym);
+    Elf32_Sym *sym = malloc(sh[i].sh_size);
+    ok = read_at(fd, strtab, str_sh->sh_size, str_sh->sh_offset) &&
+      read_at(fd, sym, sh[i].sh_size, sh[i].sh_offset);
+
+    Symbol *syms = malloc(sizeof(Symbol) * n);
+    int nr_sym = 0, j;
+    for (j = 0; ok && j < n; j ++) {
+      int type = ELF32_ST_TYPE(sym[j].st_info);
+      if ((type == STT_FUNC || type == STT_OBJECT) && sym[j].st_name < str_sh->sh_size) {
+        syms[nr_sym].addr = sym[j].st_value;
+        syms[nr_sym].size = sym[j].st_size;
+        syms[nr_sym].is_func = (type == STT_FUNC);
+        syms[nr_sym].name = strtab + sym[j].st_name;
+        nr_sym ++;
+      }
+    }
+    free(sym);
+    if (ok) {
+      qsort(syms, nr_sym, sizeof(Symbol), sym_cmp);
+      symtab.syms = syms;
+      symtab.nr_sym = nr_sym;
+      symtab.strtab = strtab;
+    }
+    else {
+      free(syms);
+      free(strtab);
+    }
+    break;
+  }
+  free(sh);
+  return ok;
+}
+
+long load_elf(const char *file, vaddr_t *entry, paddr_t *start) {
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    Log("Can not open '%s'", file);
+    return -1;
+  }
+
+  struct stat st;
+  Elf32_Ehdr eh;
+  if (fstat(fd, &st) != 0 || !read_at(fd, &eh, sizeof(eh), 0)) {
+    close(fd);
+    return -1;
+  }
+  if (eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_machine != EM_386 ||
+      (eh.e_phnum != 0 && eh.e_phentsize != sizeof(Elf32_Phdr))) {
+    Log("'%s' is not an ELF file for i386", file);
+    close(fd);
+    return -1;
+  }
+
+  Elf32_Phdr *ph = malloc(sizeof(Elf32_Phdr) * eh.e_phnum);
+  bool ok = read_at(fd, ph, sizeof(Elf32_Phdr) * eh.e_phnum, eh.e_phoff);
+
+  /* segments may also be placed below ENTRY_START */
+  paddr_t img_start = -1, img_end = 0;
+  int i;
+  for (i = 0; ok && i < eh.e_phnum; i ++) {
+    if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0) continue;
+    ok = load_segment(fd, st.st_size, &ph[i]);
+    if (ph[i].p_paddr < img_start) { img_start = ph[i].p_paddr; }
+    if (ph[i].p_paddr + ph[i].p_memsz > img_end) {
+      img_end = ph[i].p_paddr + ph[i].p_memsz;
+    }
+  }
+  if (img_start > img_end) { img_start = img_end = ENTRY_START; }
+  free(ph);
+
+  if (ok) {
+    ok = load_symtab(fd, &eh);
+    Log("%d symbols are loaded", symtab.nr_sym);
+  }
+
+  /* the file can be closed, the mappings keep a reference to it */
+  close(fd);
+  if (!ok) return -1;
+
+  *entry = eh.e_entry;
+  *start = img_start;
+  return img_end - img_start;
+}
+
+const char* elf_func_name(vaddr_t addr) {
+  Symbol *syms = symtab.syms;
+  int nr_sym = symtab.nr_sym;
+  /* find the last symbol whose address <= addr */
+  int l = 0, r = nr_sym - 1, i = -1;
+  while (l <= r) {
+    int mid = (l + r) / 2;
+    if (syms[mid].addr <= addr) { i = mid; l = mid + 1; }
+    else { r = mid - 1; }
+  }
+
+  for (; i >= 0; i --) {
+    Symbol *s = &syms[i];
+    if (s->is_func && (addr < s->addr + s->size || (s->size == 0 && s->addr == addr))) {
+      return s->name;
+    }
+    if (s->addr + s->size <= addr && s->is_func) break;
+  }
+  return NULL;
+}
+
+bool elf_sym_addr(const char *name, vaddr_t *addr) {
+  int i;
+  for (i = 0; i < symtab.nr_sym; i ++) {
+    if (strcmp(symtab.syms[i].name, name) == 0) {
+      *addr = symtab.syms[i].addr;
+      return true;
+    }
+  }
+  return false;
+}
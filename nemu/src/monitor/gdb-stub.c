@@ -0,0 +1,300 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/breakpoint.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+/* A stub of the GDB remote protocol, which is served on a local TCP
+ * port. Attach to it by
+ *   (gdb) target remote :PORT
+ * The guest runs at full speed between stops, and gdb breakpoints are
+ * the breakpoints of the monitor.
+ */
+
+/* registers in the order of the `g' packet of i386 */
+enum { GDB_EIP = 8, GDB_EFLAGS, GDB_CS, GDB_SS, GDB_DS, GDB_ES, GDB_FS, GDB_GS, NR_GDB_REG };
+
+/* instructions executed between two checks of the interrupt from gdb */
+#define CONT_CHUNK (1 << 20)
+
+#define PKT_SIZE 4096
+
+void cpu_exec(uint64_t);
+bool cpu_stopped_at_bp();
+
+static int gdb_fd = -1;
+static bool ack_mode = true;
+static uint8_t in_buf[PKT_SIZE];
+static int in_len = 0, in_pos = 0;
+
+/* the next byte from gdb without consuming it, or -1 if closed */
+static int gdb_peekc() {
+  if (in_pos == in_len) {
+    in_len = read(gdb_fd, in_buf, sizeof(in_buf));
+    in_pos = 0;
+    if (in_len <= 0) { in_len = 0; return -1; }
+  }
+  return in_buf[in_pos];
+}
+
+static int gdb_getc() {
+  int c = gdb_peekc();
+  if (c != -1) { in_pos ++; }
+  return c;
+}
+
+static void gdb_write(const void *buf, size_t len) {
+  ssize_t ret = write(gdb_fd, buf, len);
+  Assert(ret == len, "Can not write to gdb");
+}
+
+static int hex_nibble(int c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static const char hex_digit[] = "0123456789abcdef";
+
+static char *hex_encode(char *p, const uint8_t *data, int len) {
+  int i;
+  for (i = 0; i < len; i ++) {
+    *p ++ = hex_digit[data[i] >> 4];
+    *p ++ = hex_digit[data[i] & 0xf];
+  }
+  *p = '\0';
+  return p;
+}
+
+static bool hex_decode(uint8_t *data, const char *p, int len) {
+  int i;
+  for (i = 0; i < len; i ++) {
+    int hi = hex_nibble(p[2 * i]), lo = hex_nibble(p[2 * i + 1]);
+    if (hi < 0 || lo < 0) return false;
+    data[i] = (hi << 4) | lo;
+  }
+  return true;
+}
+
+/* Receive a packet into `buf' without `$' and the checksum.
+ * Return the length of the packet, or -1 if the connection is closed. */
+static int recv_packet(char *buf) {
+  int c;
+  while (true) {
+    while ((c = gdb_getc()) != '$') {
+      if (c == -1) return -1;
+    }
+
+    int len = 0;
+    uint8_t sum = 0;
+    while ((c = gdb_getc()) != '#') {
+      if (c == -1) return -1;
+      if (len < PKT_SIZE - 1) { buf[len ++] = c; }
+      sum += c;
+    }
+    buf[len] = '\0';
+    int hi = hex_nibble(gdb_getc()), lo = hex_nibble(gdb_getc());
+
+    if (!ack_mode) return len;
+    if (((hi << 4) | lo) == sum) {
+      gdb_write("+", 1);
+      return len;
+    }
+    gdb_write("-", 1);
+  }
+}
+
+static void send_packet(const char *data) {
+  static char pkt[PKT_SIZE + 4];
+  int len = strlen(data);
+  uint8_t sum = 0;
+  int i;
+  for (i = 0; i < len; i ++) { sum += data[i]; }
+  pkt[0] = '$';
+  memcpy(pkt + 1, data, len);
+  sprintf(pkt + 1 + len, "#%02x", sum);
+
+  do {
+    gdb_write(pkt, len + 4);
+  } while (ack_mode && gdb_getc() == '-');
+}
+
+static uint32_t *gdb_reg(int i) {
+  static uint32_t dummy;
+  if (i < 8) return &reg_l(i);
+  if (i == GDB_EIP) return &cpu.eip;
+  if (i == GDB_EFLAGS) return &cpu.eflags.val;
+  if (i == GDB_CS) return &cpu.cs;
+  /* the other segment registers are not modeled yet */
+  dummy = 0;
+  return &dummy;
+}
+
+/* memory is only accessed in the physical memory, so that MMIO is not
+ * triggered by the debugger */
+static bool mem_ok(uint32_t addr, uint32_t len) {
+  return len < PKT_SIZE / 2 && (uint64_t)addr + len <= pmem_size;
+}
+
+/* check whether gdb has sent an interrupt (^C), other bytes are left
+ * to recv_packet() */
+static bool gdb_interrupted() {
+  struct pollfd pfd = { .fd = gdb_fd, .events = POLLIN };
+  if (in_pos == in_len && poll(&pfd, 1, 0) <= 0) return false;
+  int c = gdb_peekc();
+  if (c == 0x03) { in_pos ++; }
+  return c == 0x03 || c == -1;
+}
+
+static void stop_reply(char *reply) {
+  if (nemu_state == NEMU_END) { sprintf(reply, "W%02x", cpu.eax & 0xff); }
+  else if (nemu_state == NEMU_ABORT) { strcpy(reply, "X06"); }
+  else { strcpy(reply, "S05"); }
+}
+
+static void gdb_continue(char *reply) {
+  do {
+    cpu_exec(CONT_CHUNK);
+  } while (nemu_state == NEMU_STOP && !cpu_stopped_at_bp() && !gdb_interrupted());
+  stop_reply(reply);
+}
+
+static void gdb_breakpoint(char *cmd, char *reply) {
+  uint32_t addr;
+  char type;
+  if (sscanf(cmd, "%c0,%x", &type, &addr) != 2) {
+    /* only software breakpoints are supported */
+    reply[0] = '\0';
+    return;
+  }
+  if (type == 'Z') { bp_add(addr); }
+  else { bp_del(addr); }
+  strcpy(reply, "OK");
+}
+
+/* Handle a packet. Return false to end the session. */
+static bool gdb_handle(char *cmd, char *reply) {
+  uint32_t addr, len, val;
+  int i;
+  reply[0] = '\0';
+
+  switch (cmd[0]) {
+    case '?': stop_reply(reply); break;
+    case 'g': {
+                char *p = reply;
+                for (i = 0; i < NR_GDB_REG; i ++) {
+                  p = hex_encode(p, (void *)gdb_reg(i), 4);
+                }
+                break;
+              }
+    case 'G':
+              for (i = 0; i < NR_GDB_REG && strlen(cmd + 1) >= (i + 1) * 8; i ++) {
+                hex_decode((void *)gdb_reg(i), cmd + 1 + i * 8, 4);
+              }
+              strcpy(reply, "OK");
+              break;
+    case 'p':
+              i = strtoul(cmd + 1, NULL, 16);
+              if (i < NR_GDB_REG) { hex_encode(reply, (void *)gdb_reg(i), 4); }
+              else { strcpy(reply, "E01"); }
+              break;
+    case 'P': {
+                char *eq = strchr(cmd, '=');
+                i = strtoul(cmd + 1, NULL, 16);
+                if (eq != NULL && i < NR_GDB_REG && hex_decode((void *)gdb_reg(i), eq + 1, 4)) {
+                  strcpy(reply, "OK");
+                }
+                else { strcpy(reply, "E01"); }
+                break;
+              }
+    case 'm':
+              if (sscanf(cmd + 1, "%x,%x", &addr, &len) == 2 && mem_ok(addr, len)) {
+                hex_encode(reply, guest_to_host(addr), len);
+              }
+              else { strcpy(reply, "E01"); }
+              break;
+    case 'M': {
+                char *data = strchr(cmd, ':');
+                if (sscanf(cmd + 1, "%x,%x", &addr, &len) == 2 && data != NULL &&
+                    mem_ok(addr, len) && hex_decode(guest_to_host(addr), data + 1, len)) {
+                  strcpy(reply, "OK");
+                }
+                else { strcpy(reply, "E01"); }
+                break;
+              }
+    case 'c':
+              if (sscanf(cmd + 1, "%x", &val) == 1) { cpu.eip = val; }
+              gdb_continue(reply);
+              break;
+    case 's':
+              if (sscanf(cmd + 1, "%x", &val) == 1) { cpu.eip = val; }
+              cpu_exec(1);
+              stop_reply(reply);
+              break;
+    case 'Z':
+    case 'z': gdb_breakpoint(cmd, reply); break;
+    case 'H': strcpy(reply, "OK"); break;
+    case 'k': return false;
+    case 'D': send_packet("OK"); return false;
+    case 'q':
+              if (strncmp(cmd, "qSupported", 10) == 0) {
+                sprintf(reply, "PacketSize=%x;QStartNoAckMode+", PKT_SIZE);
+              }
+              else if (strcmp(cmd, "qAttached") == 0) { strcpy(reply, "1"); }
+              else if (strcmp(cmd, "qC") == 0) { strcpy(reply, "QC1"); }
+              break;
+    case 'Q':
+              if (strcmp(cmd, "QStartNoAckMode") == 0) {
+                send_packet("OK");
+                ack_mode = false;
+                return true;
+              }
+              break;
+    default: break;
+  }
+
+  send_packet(reply);
+  return true;
+}
+
+void init_gdb(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  Assert(fd >= 0, "Can not create the socket for gdb");
+  int opt = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+  struct sockaddr_in sa = {
+    .sin_family = AF_INET,
+    .sin_port = htons(port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+  };
+  Assert(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Can not bind port %d for gdb", port);
+  Assert(listen(fd, 1) == 0, "Can not listen on port %d for gdb", port);
+
+  Log("Waiting for gdb on port %d", port);
+  gdb_fd = accept(fd, NULL, NULL);
+  Assert(gdb_fd >= 0, "Can not accept the connection from gdb");
+  close(fd);
+
+  setsockopt(gdb_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  Log("gdb is connected");
+}
+
+void gdb_mainloop() {
+  static char cmd[PKT_SIZE], reply[PKT_SIZE];
+  while (recv_packet(cmd) >= 0) {
+    if (!gdb_handle(cmd, reply)) break;
+  }
+  close(gdb_fd);
+  gdb_fd = -1;
+}
+
+bool gdb_enabled() {
+  return gdb_fd != -1;
+}
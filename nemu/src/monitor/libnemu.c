@@ -0,0 +1,117 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/elf.h"
+#include "cpu/perfcnt.h"
+#include "cpu/intr.h"
+#include "libnemu.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/* The state of the guest lives in thread-local variables (see NEMU_TLS),
+ * and an instance keeps its copy of them. It is switched in before the
+ * guest is accessed, and switched out after that. The physical memory is
+ * switched by the pointer, so switching is cheap.
+ */
+
+struct NEMU {
+  CPU_state cpu;
+  int state;
+  uint64_t nr_instr;
+  PerfCnt perfcnt;
+  uint8_t *pmem;
+  uint32_t pmem_size;
+  SymTab symtab;
+};
+
+void cpu_exec(uint64_t);
+
+static void switch_in(NEMU *nemu) {
+  cpu = nemu->cpu;
+  nemu_state = nemu->state;
+  set_nr_guest_instr(nemu->nr_instr);
+  perfcnt = nemu->perfcnt;
+  pmem = nemu->pmem;
+  pmem_size = nemu->pmem_size;
+  symtab = nemu->symtab;
+  /* the vectors cached by the thread may come from another instance */
+  intr_idt_flush();
+}
+
+static void switch_out(NEMU *nemu) {
+  nemu->cpu = cpu;
+  nemu->state = nemu_state;
+  nemu->nr_instr = get_nr_guest_instr();
+  nemu->perfcnt = perfcnt;
+  nemu->pmem = pmem;
+  nemu->pmem_size = pmem_size;
+  nemu->symtab = symtab;
+}
+
+NEMU* nemu_create(uint32_t mem_mb) {
+  if ((uint64_t)mem_mb << 20 > PMEM_SIZE_MAX) return NULL;
+
+  NEMU *nemu = calloc(1, sizeof(NEMU));
+  if (nemu == NULL) return NULL;
+  nemu->state = NEMU_STOP;
+  nemu->cpu.eip = ENTRY_START;
+  nemu->cpu.eflags.val = 0x2;
+  nemu->cpu.cs = 0x8;
+  nemu->pmem_size = PMEM_SIZE_DEFAULT;
+
+  switch_in(nemu);
+  init_mem(mem_mb << 20, PMEM_HUGE_NONE);
+  switch_out(nemu);
+  return nemu;
+}
+
+long nemu_load(NEMU *nemu, const char *img_file) {
+  FILE *fp = fopen(img_file, "rb");
+  if (fp == NULL) return -1;
+
+  long size = -1;
+  switch_in(nemu);
+  /* nothing of the image loaded before is left, e.g. in .bss */
+  if (!reset_mem()) {
+    size = -1;
+  }
+  else if (is_elf(img_file)) {
+    paddr_t start;
+    size = load_elf(img_file, &cpu.eip, &start);
+  }
+  else {
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (ENTRY_START + size > pmem_size || fread(guest_to_host(ENTRY_START), size, 1, fp) != 1) {
+      size = -1;
+    }
+    cpu.eip = ENTRY_START;
+  }
+  /* the new image can be run even if the old one has ended */
+  if (size >= 0) { nemu_state = NEMU_STOP; }
+  switch_out(nemu);
+
+  fclose(fp);
+  return size;
+}
+
+int nemu_run(NEMU *nemu, uint64_t n) {
+  switch_in(nemu);
+  cpu_exec(n);
+  switch_out(nemu);
+  return nemu->state;
+}
+
+uint32_t nemu_exit_code(NEMU *nemu) {
+  return nemu->cpu.eax;
+}
+
+uint64_t nemu_instr_count(NEMU *nemu) {
+  return nemu->nr_instr;
+}
+
+void nemu_destroy(NEMU *nemu) {
+  munmap(nemu->pmem, nemu->pmem_size);
+  free_symtab(&nemu->symtab);
+  free(nemu);
+}
@@ -1,19 +1,47 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
+#include "device/replay.h"
+#include "monitor/elf.h"
+#include "monitor/expr.h"
+#include "memory/cache.h"
+#include "cpu/branch.h"
+#include "memory/trace.h"
 #include <unistd.h>
+#include <stdlib.h>
 
-void init_difftest(char *ref_so_file, long img_size);
+void init_difftest(char *ref_so_file, paddr_t img_start, long img_size, bool async);
 void init_regex();
 void init_wp_pool();
 void init_device();
+void init_vclock(uint32_t);
+void init_disk(const char *);
+void init_script(const char *);
+void init_gdb(int);
+void init_coverage(const char *);
 
 void reg_test();
 
 FILE *log_fp = NULL;
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
+static int diff_async = false;
 static char *img_file = NULL;
 static int is_batch_mode = false;
+static uint32_t vclock_mhz = 0;
+static char *journal_file = NULL;
+static char *disk_file = NULL;
+static char *script_file = NULL;
+static int gdb_port = 0;
+static char *expr_file = NULL;
+static int journal_mode = REPLAY_OFF;
+static vaddr_t img_entry = ENTRY_START;
+static paddr_t img_start = ENTRY_START;
+static uint32_t mem_size_mb = 0;
+static int mem_huge = PMEM_HUGE_NONE;
+static char *cache_spec = NULL;
+static char *branch_spec = NULL;
+static char *cov_file = NULL;
+static char *trace_file = NULL;
 
 static inline void init_log() {
 #ifdef DEBUG
@@ -53,6 +81,7 @@ static inline int load_default_img() {
 
   Log("No image is given. Use the default build-in image.");
 
+  Assert(ENTRY_START + sizeof(img) <= pmem_size, "The image does not fit in the physical memory");
   memcpy(guest_to_host(ENTRY_START), img, sizeof(img));
 
   return sizeof(img);
@@ -63,6 +92,11 @@ static inline long load_img() {
   if (img_file == NULL) {
     size = load_default_img();
   }
+  else if (is_elf(img_file)) {
+    Log("The image is %s (ELF)", img_file);
+    size = load_elf(img_file, &img_entry, &img_start);
+    Assert(size >= 0, "Can not load '%s'", img_file);
+  }
   else {
     int ret;
 
@@ -75,6 +109,7 @@ static inline long load_img() {
     size = ftell(fp);
 
     fseek(fp, 0, SEEK_SET);
+    Assert(ENTRY_START + size <= pmem_size, "The image (%ld bytes) does not fit in the physical memory", size);
     ret = fread(guest_to_host(ENTRY_START), size, 1, fp);
     assert(ret == 1);
 
@@ -85,22 +120,42 @@ static inline long load_img() {
 
 static inline void restart() {
   /* Set the initial instruction pointer. */
-  cpu.eip = ENTRY_START;
+  cpu.eip = img_entry;
+  cpu.eflags.val = 0x2;
+  cpu.cs = 0x8;
 }
 
 static inline void parse_args(int argc, char *argv[]) {
   int o;
-  while ( (o = getopt(argc, argv, "-bl:d:")) != -1) {
+  while ( (o = getopt(argc, argv, "-bal:d:t:r:R:D:m:H:s:g:e:c:p:C:T:")) != -1) {
     switch (o) {
       case 'b': is_batch_mode = true; break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'a': diff_async = true; break;
+      case 't': vclock_mhz = atoi(optarg); break;
+      case 'r': journal_file = optarg; journal_mode = REPLAY_RECORD; break;
+      case 'R': journal_file = optarg; journal_mode = REPLAY_PLAY; break;
+      case 'D': disk_file = optarg; break;
+      case 's': script_file = optarg; break;
+      case 'g': gdb_port = atoi(optarg); break;
+      case 'e': expr_file = optarg; break;
+      case 'm': mem_size_mb = atoi(optarg); break;
+      case 'c': cache_spec = optarg; break;
+      case 'p': branch_spec = optarg; break;
+      case 'C': cov_file = optarg; break;
+      case 'T': trace_file = optarg; break;
+      case 'H':
+                if (strcmp(optarg, "thp") == 0) mem_huge = PMEM_HUGE_THP;
+                else if (strcmp(optarg, "hugetlb") == 0) mem_huge = PMEM_HUGE_TLB;
+                else panic("Unknown huge page mode '%s', use 'thp' or 'hugetlb'", optarg);
+                break;
       case 1:
                 if (img_file != NULL) Log("too much argument '%s', ignored", optarg);
                 else img_file = optarg;
                 break;
       default:
-                panic("Usage: %s [-b] [-l log_file] [img_file]", argv[0]);
+                panic("Usage: %s [-b] [-a] [-s script] [-g gdb_port] [-e expr_file] [-l log_file] [-t vclock_mhz] [-r|-R journal] [-D disk_img] [-m mem_mb] [-H thp|hugetlb] [-c cache_spec] [-p branch_predictor] [-C cov_file] [-T trace_file] [img_file]", argv[0]);
     }
   }
 }
@@ -117,22 +172,69 @@ int init_monitor(int argc, char *argv[]) {
   /* Test the implementation of the `CPU_state' structure. */
   reg_test();
 
+  /* Allocate the physical memory. */
+  Assert(mem_size_mb <= PMEM_SIZE_MAX >> 20, "physical memory of %u MB is too large", mem_size_mb);
+  /* the image is loaded at ENTRY_START */
+  Assert(mem_size_mb == 0 || (mem_size_mb << 20) > ENTRY_START,
+      "physical memory of %u MB is too small", mem_size_mb);
+  init_mem(mem_size_mb << 20, mem_huge);
+
+  /* Configure the cache simulator. */
+#ifdef CACHE_SIM
+  init_cache(cache_spec);
+#else
+  if (cache_spec != NULL) { Log("CACHE_SIM is not defined in include/common.h, '-c' is ignored"); }
+#endif
+
+  /* Configure the branch predictor to profile with. */
+#ifdef BRANCH_PROF
+  init_branch_prof(branch_spec);
+#else
+  if (branch_spec != NULL) { Log("BRANCH_PROF is not defined in include/common.h, '-p' is ignored"); }
+#endif
+
+  /* Open the trace of memory accesses. */
+#ifdef MEM_TRACE
+  init_mem_trace(trace_file);
+#else
+  if (trace_file != NULL) { Log("MEM_TRACE is not defined in include/common.h, '-T' is ignored"); }
+#endif
+
   /* Load the image to memory. */
   long img_size = load_img();
 
   /* Initialize this virtual computer system. */
   restart();
 
+  /* Open the coverage maps, the entry is the first block. */
+  init_coverage(cov_file);
+
   /* Compile the regular expressions. */
   init_regex();
 
+  /* Test the expression evaluator in batch and exit. */
+  if (expr_file != NULL) { exit(expr_batch(expr_file) != 0); }
+
   /* Initialize the watchpoint pool. */
   init_wp_pool();
 
+  /* Initialize the virtual clock before the devices which use it. */
+  init_vclock(vclock_mhz);
+
+  /* Open the journal of device inputs before the devices which use it. */
+  init_replay(journal_mode, journal_file);
+
   /* Initialize devices. */
   init_device();
+  init_disk(disk_file);
+
+  init_difftest(diff_so_file, img_start, img_size, diff_async);
+
+  /* Open the command script. */
+  init_script(script_file);
 
-  init_difftest(diff_so_file, img_size);
+  /* Wait for gdb to connect. */
+  if (gdb_port != 0) { init_gdb(gdb_port); }
 
   /* Display welcome message. */
   welcome();
@@ -0,0 +1,273 @@
+/* Map the coverage maps written by `nemu -C FILE' back to the guest
+ * program. The basic blocks of the ELF file are recovered from
+ * `objdump -d' (function entries, branch targets and the instructions
+ * after branches), and a block is covered if its hash is marked in the
+ * block map of any of the given files. Source lines come from the DWARF
+ * line table through `addr2line', so build the program with -g.
+ *
+ * Blocks whose hashes collide with covered blocks are reported as covered.
+ */
+
+#include "monitor/coverage.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct {
+  uint32_t addr;
+  int func;
+  bool is_start, covered;
+  int file, line;
+} Instr;
+
+typedef struct {
+  char *name;
+  int nr_block, nr_covered;
+} Func;
+
+static uint8_t edge_map[COV_MAP_SIZE], block_map[COV_MAP_SIZE];
+
+static Instr *instr = NULL;
+static int nr_instr = 0, cap_instr = 0;
+static Func *func = NULL;
+static int nr_func = 0, cap_func = 0;
+static uint32_t *target = NULL;
+static int nr_target = 0, cap_target = 0;
+static char **file = NULL;
+static int nr_file = 0, cap_file = 0;
+
+#define grow(arr, nr, cap) do { \
+  if (nr == cap) { \
+    cap = (cap == 0 ? 256 : cap * 2); \
+    arr = realloc(arr, sizeof(arr[0]) * cap); \
+    assert(arr); \
+  } \
+} while (0)
+
+static void load_map(const char *name) {
+  static uint8_t buf[COV_MAP_SIZE * 2];
+  FILE *fp = fopen(name, "rb");
+  if (fp == NULL) { perror(name); exit(1); }
+  if (fread(buf, 1, sizeof(buf), fp) != sizeof(buf) || fgetc(fp) != EOF) {
+    fprintf(stderr, "%s is not a coverage file of NEMU\n", name);
+    exit(1);
+  }
+  fclose(fp);
+
+  int i;
+  for (i = 0; i < COV_MAP_SIZE; i ++) {
+    edge_map[i] |= buf[i];
+    block_map[i] |= buf[COV_MAP_SIZE + i];
+  }
+}
+
+static bool is_branch(const char *op) {
+  static const char *prefix[] = { "j", "call", "ret", "loop", "iret", "lret", "ljmp" };
+  int i;
+  for (i = 0; i < sizeof(prefix) / sizeof(prefix[0]); i ++) {
+    if (strncmp(op, prefix[i], strlen(prefix[i])) == 0) return true;
+  }
+  return false;
+}
+
+static void disassemble(const char *elf) {
+  char cmd[1024], line[4096], name[1024];
+  snprintf(cmd, sizeof(cmd), "objdump -d -w '%s'", elf);
+  FILE *fp = popen(cmd, "r");
+  assert(fp);
+
+  bool after_branch = false;
+  uint32_t addr;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (sscanf(line, "%x <%1023[^>]>:", &addr, name) == 2) {
+      grow(func, nr_func, cap_func);
+      func[nr_func ++] = (Func) { .name = strdup(name) };
+      grow(target, nr_target, cap_target);
+      target[nr_target ++] = addr;
+      after_branch = false;
+      continue;
+    }
+
+    /* "  addr:\tbytes\tmnemonic operands" */
+    char *bytes = strchr(line, '\t'), *op = (bytes ? strchr(bytes + 1, '\t') : NULL);
+    if (nr_func == 0 || op == NULL || sscanf(line, " %x:", &addr) != 1) continue;
+    op ++;
+
+    grow(instr, nr_instr, cap_instr);
+    instr[nr_instr ++] = (Instr) { .addr = addr, .func = nr_func - 1, .is_start = after_branch };
+
+    after_branch = is_branch(op);
+    uint32_t t;
+    if (after_branch && sscanf(op, "%*s %x <", &t) == 1) {
+      grow(target, nr_target, cap_target);
+      target[nr_target ++] = t;
+    }
+  }
+  pclose(fp);
+}
+
+static int u32_cmp(const void *a, const void *b) {
+  uint32_t x = *(uint32_t *)a, y = *(uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void find_blocks() {
+  qsort(target, nr_target, sizeof(target[0]), u32_cmp);
+  int i;
+  bool covered = false;
+  for (i = 0; i < nr_instr; i ++) {
+    Instr *p = &instr[i];
+    if (!p->is_start) {
+      p->is_start = (bsearch(&p->addr, target, nr_target, sizeof(target[0]), u32_cmp) != NULL);
+    }
+    /* an instruction belongs to the block starting at or before it */
+    if (p->is_start) {
+      covered = (block_map[cov_hash(p->addr)] != 0);
+      func[p->func].nr_block ++;
+      func[p->func].nr_covered += covered;
+    }
+    p->covered = covered;
+  }
+}
+
+static int file_id(const char *name) {
+  int i;
+  for (i = 0; i < nr_file; i ++) {
+    if (strcmp(file[i], name) == 0) return i;
+  }
+  grow(file, nr_file, cap_file);
+  file[nr_file] = strdup(name);
+  return nr_file ++;
+}
+
+static void source_lines(const char *elf) {
+  char tmp[] = "/tmp/cov-report-XXXXXX";
+  int fd = mkstemp(tmp);
+  assert(fd >= 0);
+  FILE *fp = fdopen(fd, "w");
+  int i;
+  for (i = 0; i < nr_instr; i ++) { fprintf(fp, "%x\n", instr[i].addr); }
+  fclose(fp);
+
+  char cmd[2048], line[4096];
+  snprintf(cmd, sizeof(cmd), "addr2line -e '%s' < %s", elf, tmp);
+  fp = popen(cmd, "r");
+  assert(fp);
+  for (i = 0; i < nr_instr && fgets(line, sizeof(line), fp) != NULL; i ++) {
+    instr[i].file = -1;
+    char *colon = strrchr(line, ':');
+    if (colon == NULL) continue;
+    *colon = '\0';
+    int n = atoi(colon + 1);
+    if (n == 0 || strcmp(line, "??") == 0) continue;
+    instr[i].file = file_id(line);
+    instr[i].line = n;
+  }
+  pclose(fp);
+  unlink(tmp);
+}
+
+static int line_cmp(const void *a, const void *b) {
+  const Instr *x = a, *y = b;
+  if (x->file != y->file) return x->file - y->file;
+  if (x->line != y->line) return x->line - y->line;
+  return y->covered - x->covered;
+}
+
+static void print_range(int from, int to) {
+  if (from == to) printf(" %d", from);
+  else printf(" %d-%d", from, to);
+}
+
+/* A line is uncovered if none of its instructions is covered. The
+ * instructions of a line are sorted with the covered ones first. */
+static void print_uncovered_lines() {
+  qsort(instr, nr_instr, sizeof(instr[0]), line_cmp);
+  int i, cur_file = -1, from = -1, to = -1;
+  bool has_line = false, has_header = false;
+  for (i = 0; i < nr_instr; i ++) {
+    Instr *p = &instr[i];
+    if (p->file < 0) continue;
+    has_line = true;
+    if (i > 0 && instr[i - 1].file == p->file && instr[i - 1].line == p->line) continue;
+
+    if (p->file != cur_file) {
+      if (from != -1) { print_range(from, to); from = -1; }
+      if (has_header) { printf("\n"); has_header = false; }
+      cur_file = p->file;
+    }
+    if (p->covered) continue;
+
+    if (from != -1 && p->line == to + 1) {
+      to = p->line;
+      continue;
+    }
+    if (from != -1) { print_range(from, to); }
+    if (!has_header) {
+      printf("%s:", file[p->file]);
+      has_header = true;
+    }
+    from = to = p->line;
+  }
+  if (from != -1) { print_range(from, to); }
+  if (has_header) { printf("\n"); }
+  if (!has_line) { printf("no line information, build the program with -g\n"); }
+}
+
+static int func_cmp(const void *a, const void *b) {
+  const Func *x = a, *y = b;
+  double rx = (double)x->nr_covered / (x->nr_block ? x->nr_block : 1);
+  double ry = (double)y->nr_covered / (y->nr_block ? y->nr_block : 1);
+  if (rx != ry) return (rx > ry) - (rx < ry);
+  return strcmp(x->name, y->name);
+}
+
+int main(int argc, char *argv[]) {
+  bool list_lines = false, list_all = false;
+  int o;
+  while ((o = getopt(argc, argv, "la")) != -1) {
+    switch (o) {
+      case 'l': list_lines = true; break;
+      case 'a': list_all = true; break;
+      default: optind = argc; break;
+    }
+  }
+  if (argc - optind < 2) {
+    fprintf(stderr, "Usage: %s [-l] [-a] elf_file cov_file...\n"
+        "  -l  list the uncovered source lines\n"
+        "  -a  list the fully covered functions too\n", argv[0]);
+    return 1;
+  }
+
+  const char *elf = argv[optind];
+  int i;
+  for (i = optind + 1; i < argc; i ++) { load_map(argv[i]); }
+  disassemble(elf);
+  find_blocks();
+
+  int nr_edge = 0, nr_block = 0, nr_covered = 0;
+  for (i = 0; i < COV_MAP_SIZE; i ++) { nr_edge += (edge_map[i] != 0); }
+  for (i = 0; i < nr_func; i ++) {
+    nr_block += func[i].nr_block;
+    nr_covered += func[i].nr_covered;
+  }
+  printf("%d edges, %d/%d blocks covered (%.1f%%)\n", nr_edge, nr_covered, nr_block,
+      100.0 * nr_covered / (nr_block ? nr_block : 1));
+
+  if (list_lines) { source_lines(elf); }
+
+  Func *sorted = malloc(sizeof(Func) * (nr_func + 1));
+  assert(sorted);
+  memcpy(sorted, func, sizeof(Func) * nr_func);
+  qsort(sorted, nr_func, sizeof(Func), func_cmp);
+  printf("%-32s %8s %8s %7s\n", "function", "blocks", "covered", "rate");
+  for (i = 0; i < nr_func; i ++) {
+    Func *f = &sorted[i];
+    if (f->nr_block == 0 || (f->nr_covered == f->nr_block && !list_all)) continue;
+    printf("%-32s %8d %8d %6.1f%%\n", f->name, f->nr_block, f->nr_covered,
+        100.0 * f->nr_covered / f->nr_block);
+  }
+
+  if (list_lines) { print_uncovered_lines(); }
+  return 0;
+}
@@ -0,0 +1,149 @@
+/* Benchmark of the ModR/M decoder in NEMU.
+ *
+ * A synthetic stream of memory operands (ModR/M byte, optional SIB byte
+ * and displacement) is decoded by load_addr() from src/cpu/decode/modrm.c,
+ * and by the reference decoder below, which follows the i386 manual with
+ * plain branches. The effective addresses and operand lengths are checked
+ * against each other before timing.
+ */
+
+#include "cpu/exec.h"
+#include <stdlib.h>
+#include <time.h>
+
+#define NR_OPERAND (1 << 20)
+#define NR_ROUND 20
+
+/* things the decoder needs from the rest of NEMU */
+NEMU_TLS CPU_state cpu;
+NEMU_TLS DecodeInfo decoding;
+NEMU_TLS rtlreg_t t0, t1, t2, t3, at;
+NEMU_TLS PerfCnt perfcnt;
+
+static uint8_t stream[NR_OPERAND * 7];
+static uint32_t stream_len = 0;
+
+/* not inlined into the reference decoder, the same as in NEMU */
+__attribute__((noinline)) uint32_t vaddr_read(vaddr_t addr, int len) {
+  uint32_t data = 0;
+  memcpy(&data, stream + addr, len);
+  return data;
+}
+
+__attribute__((noinline)) static void ref_load_addr(vaddr_t *eip, ModR_M *m, Operand *rm) {
+  int32_t disp = 0;
+  int disp_size = 4;
+  int base_reg = -1, index_reg = -1, scale = 0;
+
+  if (m->R_M == R_ESP) {
+    SIB s;
+    s.val = instr_fetch(eip, 1);
+    base_reg = s.base;
+    scale = s.ss;
+    if (s.index != R_ESP) { index_reg = s.index; }
+  }
+  else {
+    base_reg = m->R_M;
+  }
+
+  if (m->mod == 0) {
+    if (base_reg == R_EBP) { base_reg = -1; }
+    else { disp_size = 0; }
+  }
+  else if (m->mod == 1) { disp_size = 1; }
+
+  if (disp_size != 0) {
+    disp = instr_fetch(eip, disp_size);
+    if (disp_size == 1) { disp = (int8_t)disp; }
+  }
+
+  uint32_t addr = disp;
+  if (base_reg != -1) { addr += reg_l(base_reg); }
+  if (index_reg != -1) { addr += reg_l(index_reg) << scale; }
+  rm->addr = addr;
+  rm->type = OP_TYPE_MEM;
+}
+
+static void gen_stream() {
+  int i, j;
+  for (i = 0; i < NR_OPERAND; i ++) {
+    ModR_M m;
+    m.val = rand() & 0xff;
+    if (m.mod == 3) { m.mod = rand() % 3; }
+    stream[stream_len ++] = m.val;
+    /* SIB and displacement bytes are random, the decoder decides how
+     * many of them are consumed */
+    for (j = 0; j < 6; j ++) {
+      stream[stream_len + j] = rand() & 0xff;
+    }
+    vaddr_t eip = stream_len - 1;
+    Operand op;
+    instr_fetch(&eip, 1);
+    ref_load_addr(&eip, &m, &op);
+    stream_len = eip;
+  }
+}
+
+typedef void (*decoder_t)(vaddr_t *, ModR_M *, Operand *);
+
+__attribute__((noinline)) static uint32_t run(decoder_t decoder) {
+  vaddr_t eip = 0;
+  uint32_t sum = 0;
+  Operand op;
+  ModR_M m;
+  while (eip < stream_len) {
+    m.val = instr_fetch(&eip, 1);
+    decoder(&eip, &m, &op);
+    sum += op.addr;
+  }
+  return sum;
+}
+
+static void verify() {
+  vaddr_t eip = 0, ref_eip = 0;
+  Operand op, ref_op;
+  ModR_M m;
+  while (ref_eip < stream_len) {
+    m.val = instr_fetch(&eip, 1);
+    ref_eip = eip;
+    load_addr(&eip, &m, &op);
+    ref_load_addr(&ref_eip, &m, &ref_op);
+    if (eip != ref_eip || op.addr != ref_op.addr) {
+      printf("mismatch at offset %d: ModR/M = 0x%02x, addr = 0x%08x, expected 0x%08x\n",
+          ref_eip, m.val, op.addr, ref_op.addr);
+      exit(1);
+    }
+  }
+  printf("%d operands verified\n", NR_OPERAND);
+}
+
+static void bench(const char *name, decoder_t decoder) {
+  struct timespec start, end;
+  uint32_t sum = 0;
+  int i;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 0; i < NR_ROUND; i ++) {
+    sum += run(decoder);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double sec = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%-10s %8.2f M decodes/s (checksum = 0x%08x)\n", name,
+      (double)NR_OPERAND * NR_ROUND / sec / 1e6, sum);
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+  int seed = (argc > 1 ? atoi(argv[1]) : time(0));
+  srand(seed);
+  printf("seed = %d\n", seed);
+  for (i = 0; i < 8; i ++) {
+    reg_l(i) = rand();
+  }
+
+  gen_stream();
+  verify();
+  bench("reference", ref_load_addr);
+  bench("nemu", load_addr);
+  return 0;
+}
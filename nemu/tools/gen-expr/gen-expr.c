@@ -4,6 +4,7 @@
 #include <time.h>
 #include <assert.h>
 #include <string.h>
+#include <ctype.h>
 
 static inline uint32_t choose(uint32_t n) {
     return rand() % n;
@@ -20,15 +21,25 @@ static inline int num_len(int num) {
     return snprintf(NULL, 0, "%u", num);
 }
 
+/* The literals are unsigned as in expr() of NEMU, the `u' suffix is
+ * stripped from the expression given to NEMU (see strip_suffix()). */
 static inline void gen_num() {
     uint32_t num = rand();
-    int nlen = num_len(num);
+    int nlen = num_len(num) + 1;
     if (bufpos + nlen >= bufsize - 1)
         buf_enlarge();
-    sprintf(buf + bufpos, "%u", num);
+    sprintf(buf + bufpos, "%uu", num);
     bufpos += nlen;
 }
 
+static inline void strip_suffix(char *s) {
+    char *d = s;
+    for (; *s != '\0'; s ++) {
+        if (*s != 'u') *d ++ = *s;
+    }
+    *d = '\0';
+}
+
 static inline void gen(char x) {
     if (bufpos >= bufsize - 1) buf_enlarge();
     buf[bufpos++] = x;
@@ -54,8 +65,12 @@ static inline void gen_rand_space() {
     }
 }
 
+/* the expression is closed with numbers beyond this length, otherwise
+ * it may grow without bound */
+#define MAX_EXPR_LEN 4096
+
 static inline void gen_rand_expr() {
-  switch (choose(3)) {
+  switch (bufpos > MAX_EXPR_LEN ? 0 : choose(3)) {
       case 0: gen_rand_space(); gen_num(); gen_rand_space(); break;
       case 1: gen('('); gen_rand_space(); gen_rand_expr(); gen_rand_space(); gen(')'); break;
       default: gen_rand_expr(); gen_rand_space(); gen_rand_op(); gen_rand_space(); gen_rand_expr(); break;
@@ -82,46 +97,100 @@ static inline void gen_cleanup() {
     buf = NULL;
 }
 
-static char code_buf[65536];
-static char *code_format =
+/* Expressions are compiled in batches to amortize the cost of gcc. An
+ * expression which raises SIGFPE (e.g. division by zero) is skipped,
+ * without affecting the others in the same batch.
+ *
+ * gcc folds a constant expression, and then a division by zero is not
+ * trapped. So every literal is added to the volatile `z' (which is 0),
+ * see code_of().
+ */
+static char *code_head =
 "#include <stdio.h>\n"
-"int main() { "
-"  unsigned result = %s; "
-"  printf(\"%%u\", result); "
-"  return 0; "
-"}";
-
-int main(int argc, char *argv[]) {
-  int seed = time(0);
-  srand(seed);
-  int loop = 1;
-  if (argc > 1) {
-    sscanf(argv[1], "%d", &loop);
+"#include <signal.h>\n"
+"#include <setjmp.h>\n"
+"static volatile unsigned z = 0;\n"
+"static sigjmp_buf env;\n"
+"static void fpe_handler(int sig) { siglongjmp(env, 1); }\n"
+"int main() {\n"
+"  signal(SIGFPE, fpe_handler);\n";
+static char *code_expr =
+"  if (sigsetjmp(env, 1) == 0) { unsigned result = %s; printf(\"%%u\\n\", result); }\n"
+"  else { printf(\"-\\n\"); }\n";
+static char *code_tail =
+"  return 0;\n"
+"}\n";
+
+/* `e' with every literal `N' written as `(z+N)' */
+static char *code_of(const char *e) {
+  /* a literal has at least 2 characters with the suffix */
+  char *code = malloc(strlen(e) * 3 + 1), *d = code;
+  assert(code);
+  const char *s;
+  for (s = e; *s != '\0'; s ++) {
+    if (isdigit(*s) && (s == e || !isdigit(s[-1]))) { d += sprintf(d, "(z+"); }
+    *d ++ = *s;
+    if (*s == 'u') { *d ++ = ')'; }
   }
+  *d = '\0';
+  return code;
+}
+
+static void gen_batch(int n) {
+  char **exprs = malloc(sizeof(char *) * n);
+  assert(exprs);
+  int nr_expr = 0;
+
+  FILE *fp = fopen(".code.c", "w");
+  assert(fp != NULL);
+  fputs(code_head, fp);
   int i;
-  for (i = 0; i < loop; i ++) {
+  for (i = 0; i < n; i ++) {
     gen_init();
     gen_rand_expr();
-    if (bufsize != INC) continue; // lazy
-    sprintf(code_buf, code_format, buf);
+    if (bufsize != INC) { gen_cleanup(); continue; } // lazy
+    char *code = code_of(buf);
+    fprintf(fp, code_expr, code);
+    free(code);
+    exprs[nr_expr ++] = buf;
+    buf = NULL;
+  }
+  fputs(code_tail, fp);
+  fclose(fp);
 
-    FILE *fp = fopen(".code.c", "w");
+  int ret = system("gcc -w .code.c -o .expr");
+  if (ret == 0) {
+    fp = popen("./.expr", "r");
     assert(fp != NULL);
-    fputs(code_buf, fp);
-    fclose(fp);
 
-    int ret = system("gcc -Wno-overflow -Wno-div-by-zero .code.c -o .expr");
-    if (ret != 0) continue;
+    char line[32];
+    for (i = 0; i < nr_expr && fgets(line, sizeof(line), fp) != NULL; i ++) {
+      if (line[0] != '-') {
+        strip_suffix(exprs[i]);
+        printf("%u %s\n", (uint32_t)strtoul(line, NULL, 10), exprs[i]);
+      }
+    }
+    pclose(fp);
+  }
 
-    fp = popen("./.expr", "r");
-    assert(fp != NULL);
+  for (i = 0; i < nr_expr; i ++) { free(exprs[i]); }
+  free(exprs);
+}
 
-    int result;
-    fscanf(fp, "%d", &result);
-    int code = pclose(fp);
-    if (code == 0)
-        printf("%u %s\n", result, buf);
-    gen_cleanup();
+int main(int argc, char *argv[]) {
+  int seed = time(0);
+  srand(seed);
+  int loop = 1, batch = 1;
+  if (argc > 1) {
+    sscanf(argv[1], "%d", &loop);
+  }
+  if (argc > 2) {
+    sscanf(argv[2], "%d", &batch);
+    assert(batch > 0);
+  }
+  int i;
+  for (i = 0; i < loop; i += batch) {
+    gen_batch(loop - i < batch ? loop - i : batch);
   }
   return 0;
 }
@@ -0,0 +1,84 @@
+#include "trace-reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+/* Print the records of a memory trace, or with -s a summary of them:
+ * the accesses of each kind, and the working set in pages and lines. */
+
+#define PAGE_SHIFT 12
+#define LINE_SHIFT 6
+
+static uint8_t page_map[(1u << (32 - PAGE_SHIFT)) / 8];
+static uint8_t line_map[(1u << (32 - LINE_SHIFT)) / 8];
+static uint32_t nr_page = 0, nr_line = 0;
+
+static inline void mark(uint8_t *map, uint32_t idx, uint32_t *count) {
+  if (!(map[idx >> 3] & (1 << (idx & 7)))) {
+    map[idx >> 3] |= 1 << (idx & 7);
+    (*count) ++;
+  }
+}
+
+/* the working set counts the guest memory only */
+static void touch(uint32_t addr, uint32_t len) {
+  uint32_t a;
+  for (a = addr >> LINE_SHIFT; a <= (addr + len - 1) >> LINE_SHIFT; a ++) {
+    mark(line_map, a, &nr_line);
+  }
+  for (a = addr >> PAGE_SHIFT; a <= (addr + len - 1) >> PAGE_SHIFT; a ++) {
+    mark(page_map, a, &nr_page);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bool summary = false;
+  uint64_t limit = UINT64_MAX;
+  int o;
+  while ((o = getopt(argc, argv, "sn:")) != -1) {
+    switch (o) {
+      case 's': summary = true; break;
+      case 'n': limit = strtoull(optarg, NULL, 0); break;
+      default: optind = argc; break;
+    }
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-s] [-n max_records] trace_file\n", argv[0]);
+    return 1;
+  }
+
+  TraceReader *r = trace_open(argv[optind]);
+  if (r == NULL) return 1;
+
+  TraceRecord rec;
+  uint64_t count[8] = {0}, accesses[8] = {0}, n = 0, last_instr = 0;
+  while (n < limit && trace_next(r, &rec)) {
+    n ++;
+    last_instr = rec.instr;
+    bool is_run = (rec.kind == TRACE_RUN_LOAD || rec.kind == TRACE_RUN_STORE);
+    if (!summary) {
+      printf("%12" PRIu64 " %08x %-9s %08x/%d %s%08x\n", rec.instr, rec.eip,
+          trace_kind_name[rec.kind], rec.addr, rec.width, (is_run ? "x" : "="), rec.value);
+      continue;
+    }
+
+    count[rec.kind] ++;
+    accesses[rec.kind] += (is_run ? rec.value : 1);
+    if (rec.kind == TRACE_PIO_IN || rec.kind == TRACE_PIO_OUT) continue;
+    touch(rec.addr, (is_run ? rec.value : 1) * rec.width);
+  }
+  trace_close(r);
+
+  if (summary) {
+    int i;
+    printf("%" PRIu64 " records up to instruction %" PRIu64 "\n", n, last_instr);
+    printf("%-10s %14s %14s\n", "kind", "records", "accesses");
+    for (i = 0; i < 8; i ++) {
+      printf("%-10s %14" PRIu64 " %14" PRIu64 "\n", trace_kind_name[i], count[i], accesses[i]);
+    }
+    printf("working set: %u pages (%u KB), %u lines (%u KB)\n",
+        nr_page, nr_page << (PAGE_SHIFT - 10), nr_line, nr_line << LINE_SHIFT >> 10);
+  }
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include "trace-reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+
+const char *trace_kind_name[] = {
+  "load", "store", "mmio-r", "mmio-w", "pio-in", "pio-out", "run-load", "run-store"
+};
+
+struct TraceReader {
+  FILE *fp;
+  TraceHeader h;
+  uint8_t *raw, *zbuf;
+  uint8_t *p, *end;
+  /* decoding state, which restarts in each block */
+  uint64_t instr;
+  uint32_t addr, eip;
+};
+
+TraceReader *trace_open(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) { perror(file); return NULL; }
+
+  TraceReader *r = calloc(1, sizeof(TraceReader));
+  assert(r);
+  r->fp = fp;
+  if (fread(&r->h, sizeof(r->h), 1, fp) != 1 ||
+      memcmp(r->h.magic, TRACE_MAGIC, sizeof(r->h.magic)) != 0) {
+    fprintf(stderr, "%s is not a memory trace of NEMU\n", file);
+    goto bad;
+  }
+#ifndef HAS_ZSTD
+  if (r->h.compress == TRACE_ZSTD) {
+    fprintf(stderr, "%s is compressed by zstd, rebuild with ZSTD=1\n", file);
+    goto bad;
+  }
+#endif
+
+  r->raw = malloc(r->h.block_size);
+  r->zbuf = malloc(r->h.block_size * 2);
+  assert(r->raw && r->zbuf);
+  r->p = r->end = r->raw;
+  return r;
+
+bad:
+  trace_close(r);
+  return NULL;
+}
+
+static bool read_block(TraceReader *r) {
+  uint32_t hdr[2];
+  if (fread(hdr, sizeof(hdr), 1, r->fp) != 1) return false;
+  uint32_t raw_len = hdr[0], data_len = hdr[1];
+  if (raw_len > r->h.block_size || data_len > r->h.block_size * 2) goto bad;
+
+  uint8_t *data = (r->h.compress == TRACE_RAW ? r->raw : r->zbuf);
+  if (fread(data, data_len, 1, r->fp) != 1) goto bad;
+#ifdef HAS_ZSTD
+  if (r->h.compress == TRACE_ZSTD) {
+    size_t ret = ZSTD_decompress(r->raw, r->h.block_size, data, data_len);
+    if (ZSTD_isError(ret) || ret != raw_len) goto bad;
+  }
+#endif
+
+  r->p = r->raw;
+  r->end = r->raw + raw_len;
+  r->instr = 0;
+  r->addr = r->eip = 0;
+  return true;
+
+bad:
+  fprintf(stderr, "the memory trace is truncated or corrupted\n");
+  return false;
+}
+
+static inline uint64_t get_varint(TraceReader *r) {
+  uint64_t v = 0;
+  int shift = 0;
+  while (r->p < r->end) {
+    uint8_t b = *r->p ++;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) break;
+    shift += 7;
+  }
+  return v;
+}
+
+static inline uint32_t unzigzag(uint32_t v) {
+  return (v >> 1) ^ -(v & 1);
+}
+
+bool trace_next(TraceReader *r, TraceRecord *rec) {
+  if (r->p == r->end && !read_block(r)) return false;
+
+  uint8_t tag = *r->p ++;
+  r->instr += get_varint(r);
+  r->addr += unzigzag(get_varint(r));
+  if (tag & TRACE_NEW_EIP) { r->eip += unzigzag(get_varint(r)); }
+
+  rec->kind = tag & TRACE_KIND_MASK;
+  rec->width = 1 << ((tag >> TRACE_WIDTH_SHIFT) & 0x3);
+  rec->instr = r->instr;
+  rec->addr = r->addr;
+  rec->eip = r->eip;
+  rec->value = get_varint(r);
+  return true;
+}
+
+void trace_close(TraceReader *r) {
+  if (r->fp != NULL) { fclose(r->fp); }
+  free(r->raw);
+  free(r->zbuf);
+  free(r);
+}
@@ -0,0 +1,29 @@
+#ifndef __TRACE_READER_H__
+#define __TRACE_READER_H__
+
+#include "memory/trace.h"
+
+/* A streaming reader of the memory traces written by `nemu -T'. Blocks
+ * are read and decoded one at a time, so traces of any size can be
+ * processed in constant memory. */
+
+typedef struct {
+  int kind;         // TRACE_LOAD, ...
+  int width;        // in bytes
+  uint64_t instr;   // index of the guest instruction
+  uint32_t addr;    // address, or port of PIO
+  uint32_t eip;
+  uint32_t value;   // data, or the count of a run
+} TraceRecord;
+
+typedef struct TraceReader TraceReader;
+
+/* return NULL and print the reason on failure */
+TraceReader *trace_open(const char *file);
+/* return false at the end of the trace */
+bool trace_next(TraceReader *r, TraceRecord *rec);
+void trace_close(TraceReader *r);
+
+extern const char *trace_kind_name[];
+
+#endif
@@ -4,6 +4,7 @@
 
 typedef uint32_t paddr_t;
 #define DIFFTEST_REG_SIZE (sizeof(uint32_t) * 9) // GPRs + EIP
+#define DIFFTEST_SETREG_SIZE (sizeof(uint32_t) * 11) // and eflags, cs
 
 bool gdb_connect_qemu(void);
 bool gdb_memcpy_to_qemu(uint32_t, void *, int);
@@ -26,7 +27,7 @@ void difftest_getregs(void *r) {
 void difftest_setregs(const void *r) {
   union gdb_regs qemu_r;
   gdb_getregs(&qemu_r);
-  memcpy(&qemu_r, r, DIFFTEST_REG_SIZE);
+  memcpy(&qemu_r, r, DIFFTEST_SETREG_SIZE);
   gdb_setregs(&qemu_r);
 }
 
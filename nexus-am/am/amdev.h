@@ -22,6 +22,17 @@ extern "C" {
 // ================= Device Register Specifications ==================
 
 // --------- _DEV_PERFCNT AM Performance Counter (0000ac01) ----------
+#define _DEVREG_PERFCNT_COUNTERS 1 // counted since the last reset
+  typedef struct {
+    uint64_t instr;       // guest instructions executed
+    uint64_t load, store; // memory accesses
+    uint64_t branch;      // taken branches
+    uint64_t tlb_miss;    // TLB misses
+    uint64_t intr;        // interrupts taken
+    uint64_t host_ns;     // host time elapsed (ns)
+  } _PerfCntReg;
+
+#define _DEVREG_PERFCNT_RESET    2 // write: reset all counters, no data
 
 // ------------- _DEV_INPUT: AM Input Devices (0000ac02) -------------
 #define _DEVREG_INPUT_KBD     1
@@ -79,7 +90,7 @@ extern "C" {
 // ---------- _DEV_SERIAL: AM Serial Controller (0000ac05) -----------
 
 #define _DEVREG_SERIAL_RECV 0
-#define _DEVREG_SERIAL_SEND 1
+#define _DEVREG_SERIAL_SEND 1 // write @size bytes at @buf
 #define _DEVREG_SERIAL_STAT 2
 #define _DEVREG_SERIAL_CTRL 3
 
@@ -99,6 +110,18 @@ extern "C" {
 #define _DEVREG_ATA_DRIVE     6
 #define _DEVREG_ATA_STATUS    7
 
+// paravirtual block interface (NEMU), in units of 512-byte sectors
+#define _DEVREG_ATA_BLKINFO   8
+  typedef struct {
+    uint32_t nsect; // size of the disk
+  } _BlkInfoReg;
+
+#define _DEVREG_ATA_BLKIO     9
+  typedef struct {
+    uint32_t sect, nsect; // transfer @nsect sectors starting from @sect
+    void *buf;            //   into (read) or from (write) @buf
+  } _BlkIOReg;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,80 @@
+#include <am.h>
+#include <x86.h>
+#include <amdev.h>
+
+#define DISK_PORT 0x300
+
+#define DISK_NSECT_TOTAL (DISK_PORT + 0x00)
+#define DISK_SECT        (DISK_PORT + 0x04)
+#define DISK_NSECT       (DISK_PORT + 0x08)
+#define DISK_ADDR        (DISK_PORT + 0x0c)
+#define DISK_CMD         (DISK_PORT + 0x10)
+#define DISK_STATUS      (DISK_PORT + 0x14)
+
+#define DISK_CMD_READ  1
+#define DISK_CMD_WRITE 2
+
+#define SECTOR_SIZE   512
+#define BOUNCE_NSECT  8
+
+int is_identity_mapped(const void *p, size_t len);
+
+// for the buffers which are not identity-mapped
+static uint8_t bounce_buf[BOUNCE_NSECT * SECTOR_SIZE];
+
+// the whole transfer is done by NEMU once the command is written,
+// @paddr is the physical address of the buffer
+static int disk_dma(uint32_t sect, uint32_t nsect, uint32_t paddr, int cmd) {
+  outl(DISK_SECT, sect);
+  outl(DISK_NSECT, nsect);
+  outl(DISK_ADDR, paddr);
+  outl(DISK_CMD, cmd);
+  return inl(DISK_STATUS) == 0;
+}
+
+static void copy(void *dst, const void *src, size_t n) {
+  uint8_t *d = dst;
+  const uint8_t *s = src;
+  while (n --) { *d ++ = *s ++; }
+}
+
+static size_t disk_transfer(_BlkIOReg *io, int cmd) {
+  if (is_identity_mapped(io->buf, io->nsect * SECTOR_SIZE)) {
+    return (disk_dma(io->sect, io->nsect, (uint32_t)io->buf, cmd) ? sizeof(_BlkIOReg) : 0);
+  }
+
+  // e.g. a user buffer under paging, bounce it through the kernel
+  uint8_t *p = io->buf;
+  uint32_t sect = io->sect, left = io->nsect;
+  while (left > 0) {
+    uint32_t n = (left < BOUNCE_NSECT ? left : BOUNCE_NSECT);
+    if (cmd == DISK_CMD_WRITE) { copy(bounce_buf, p, n * SECTOR_SIZE); }
+    if (!disk_dma(sect, n, (uint32_t)bounce_buf, cmd)) { return 0; }
+    if (cmd == DISK_CMD_READ) { copy(p, bounce_buf, n * SECTOR_SIZE); }
+    sect += n;
+    left -= n;
+    p += n * SECTOR_SIZE;
+  }
+  return sizeof(_BlkIOReg);
+}
+
+size_t disk_read(uintptr_t reg, void *buf, size_t size) {
+  switch (reg) {
+    case _DEVREG_ATA_BLKINFO: {
+      _BlkInfoReg *info = (_BlkInfoReg *)buf;
+      info->nsect = inl(DISK_NSECT_TOTAL);
+      return sizeof(_BlkInfoReg);
+    }
+    case _DEVREG_ATA_BLKIO:
+      return disk_transfer((_BlkIOReg *)buf, DISK_CMD_READ);
+  }
+  return 0;
+}
+
+size_t disk_write(uintptr_t reg, void *buf, size_t size) {
+  switch (reg) {
+    case _DEVREG_ATA_BLKIO:
+      return disk_transfer((_BlkIOReg *)buf, DISK_CMD_WRITE);
+  }
+  return 0;
+}
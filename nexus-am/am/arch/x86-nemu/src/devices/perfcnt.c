@@ -0,0 +1,44 @@
+#include <am.h>
+#include <x86.h>
+#include <amdev.h>
+
+#define PERFCNT_PORT 0x400
+#define PERFCNT_CTRL (PERFCNT_PORT + 0)
+#define PERFCNT_CNT  (PERFCNT_PORT + 8)
+
+#define PERFCNT_LATCH 1
+#define PERFCNT_RESET 2
+
+static inline uint64_t read_counter(int i) {
+  uint32_t lo = inl(PERFCNT_CNT + i * 8);
+  uint32_t hi = inl(PERFCNT_CNT + i * 8 + 4);
+  return ((uint64_t)hi << 32) | lo;
+}
+
+size_t perfcnt_read(uintptr_t reg, void *buf, size_t size) {
+  switch (reg) {
+    case _DEVREG_PERFCNT_COUNTERS: {
+      _PerfCntReg *cnt = (_PerfCntReg *)buf;
+      // take a snapshot so that all counters are consistent
+      outl(PERFCNT_CTRL, PERFCNT_LATCH);
+      cnt->instr = read_counter(0);
+      cnt->load = read_counter(1);
+      cnt->store = read_counter(2);
+      cnt->branch = read_counter(3);
+      cnt->tlb_miss = read_counter(4);
+      cnt->intr = read_counter(5);
+      cnt->host_ns = read_counter(6);
+      return sizeof(_PerfCntReg);
+    }
+  }
+  return 0;
+}
+
+size_t perfcnt_write(uintptr_t reg, void *buf, size_t size) {
+  switch (reg) {
+    case _DEVREG_PERFCNT_RESET:
+      outl(PERFCNT_CTRL, PERFCNT_RESET);
+      return size;
+  }
+  return 0;
+}
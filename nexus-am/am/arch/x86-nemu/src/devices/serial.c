@@ -0,0 +1,14 @@
+#include <am.h>
+#include <x86.h>
+#include <amdev.h>
+
+void serial_send(const void *buf, size_t len);
+
+size_t serial_write(uintptr_t reg, void *buf, size_t size) {
+  switch (reg) {
+    case _DEVREG_SERIAL_SEND:
+      serial_send(buf, size);
+      return size;
+  }
+  return 0;
+}
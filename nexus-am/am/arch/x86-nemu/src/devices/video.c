@@ -5,6 +5,29 @@
 
 static uint32_t* const fb __attribute__((used)) = (uint32_t *)0x40000;
 
+#define SCREEN_PORT 0x100
+
+#define BLIT_MMIO 0xc0000
+enum { BLIT_SRC, BLIT_X, BLIT_Y, BLIT_W, BLIT_H, BLIT_PITCH, BLIT_SYNC, BLIT_CMD };
+
+static volatile uint32_t* const blit = (uint32_t *)BLIT_MMIO;
+
+int is_identity_mapped(const void *p, size_t len);
+
+// the blit engine reads the physical memory, so the pixels which are not
+// identity-mapped (e.g. user space) are stored into the frame buffer here
+static void draw_pixels(_FBCtlReg *ctl) {
+  uint32_t screen = inl(SCREEN_PORT);
+  uint32_t W = screen >> 16, H = screen & 0xffff;
+  uint32_t x = ctl->x, y = ctl->y, w = ctl->w, h = ctl->h;
+  uint32_t i, j;
+  for (j = 0; j < h && y + j < H; j ++) {
+    for (i = 0; i < w && x + i < W; i ++) {
+      fb[(y + j) * W + x + i] = ctl->pixels[j * w + i];
+    }
+  }
+}
+
 size_t video_read(uintptr_t reg, void *buf, size_t size) {
   switch (reg) {
     case _DEVREG_VIDEO_INFO: {
@@ -22,9 +45,23 @@ size_t video_write(uintptr_t reg, void *buf, size_t size) {
     case _DEVREG_VIDEO_FBCTL: {
       _FBCtlReg *ctl = (_FBCtlReg *)buf;
 
-      if (ctl->sync) {
-        // do nothing, hardware syncs.
+      if (is_identity_mapped(ctl->pixels, (size_t)ctl->w * ctl->h * sizeof(uint32_t))) {
+        // let the blit engine copy the whole rectangle in one go
+        blit[BLIT_SRC] = (uintptr_t)ctl->pixels;
+        blit[BLIT_X] = ctl->x;
+        blit[BLIT_Y] = ctl->y;
+        blit[BLIT_W] = ctl->w;
+        blit[BLIT_H] = ctl->h;
+      }
+      else {
+        draw_pixels(ctl);
+        // an empty blit only syncs the screen
+        blit[BLIT_W] = 0;
+        blit[BLIT_H] = 0;
       }
+      blit[BLIT_PITCH] = ctl->w;
+      blit[BLIT_SYNC] = ctl->sync;
+      blit[BLIT_CMD] = 1;
       return sizeof(_FBCtlReg);
     }
   }
@@ -25,12 +25,20 @@ size_t timer_read(uintptr_t reg, void *buf, size_t size);
 size_t video_read(uintptr_t reg, void *buf, size_t size);
 size_t video_write(uintptr_t reg, void *buf, size_t size);
 size_t input_read(uintptr_t reg, void *buf, size_t size);
+size_t disk_read(uintptr_t reg, void *buf, size_t size);
+size_t disk_write(uintptr_t reg, void *buf, size_t size);
+size_t serial_write(uintptr_t reg, void *buf, size_t size);
+size_t perfcnt_read(uintptr_t reg, void *buf, size_t size);
+size_t perfcnt_write(uintptr_t reg, void *buf, size_t size);
 
 
 static _Device n86_dev[] = {
   {_DEV_TIMER,   "NEMU Timer", timer_read, no_write},
   {_DEV_INPUT,   "NEMU Keyboard Controller", input_read, no_write},
   {_DEV_VIDEO,   "NEMU VGA Controller", video_read, video_write},
+  {_DEV_ATA0,    "NEMU Disk", disk_read, disk_write},
+  {_DEV_SERIAL,  "NEMU Serial", no_read, serial_write},
+  {_DEV_PERFCNT, "NEMU Performance Counter", perfcnt_read, perfcnt_write},
 };
 
 #define NR_DEV (sizeof(n86_dev) / sizeof(n86_dev[0]))
@@ -2,6 +2,8 @@
 #include <x86.h>
 
 #define SERIAL_PORT 0x3f8
+#define SERIAL_BULK_PORT 0x3e0
+#define MEMSIZE_PORT 0x480
 
 extern char _heap_start;
 extern char _heap_end;
@@ -12,6 +14,25 @@ _Area _heap = {
   .end = &_heap_end,
 };
 
+// whether [@p, @p + @len) has the same virtual and physical addresses,
+// which holds for the kernel mappings of vme.c
+int is_identity_mapped(const void *p, size_t len) {
+  uintptr_t addr = (uintptr_t)p;
+  return !(get_cr0() & CR0_PG) || (addr < PMEM_SIZE && len <= PMEM_SIZE - addr);
+}
+
+// send @len bytes at @buf with one bulk transfer, which reads the physical
+// memory, or byte by byte if @buf is not identity-mapped (e.g. user space)
+void serial_send(const void *buf, size_t len) {
+  if (!is_identity_mapped(buf, len)) {
+    const char *p = buf;
+    for (; len > 0; len --) { _putc(*p ++); }
+    return;
+  }
+  outl(SERIAL_BULK_PORT, (uint32_t)buf);
+  outl(SERIAL_BULK_PORT + 4, len);
+}
+
 void _putc(char ch) {
   while ((inb(SERIAL_PORT + 5) & 0x20) == 0);
   outb(SERIAL_PORT, ch);
@@ -25,6 +46,12 @@ void _halt(int code) {
 }
 
 void _trm_init() {
+  // the size of the physical memory is given by NEMU (0 if unknown)
+  uint32_t memsize = inl(MEMSIZE_PORT);
+  if (memsize != 0 && memsize > (uintptr_t)_heap.start) {
+    _heap.end = (void *)memsize;
+  }
+
   int ret = main();
   _halt(ret);
 }
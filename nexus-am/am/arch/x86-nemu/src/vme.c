@@ -17,6 +17,11 @@ int _vme_init(void* (*pgalloc_f)(size_t), void (*pgfree_f)(void*)) {
   pgalloc_usr = pgalloc_f;
   pgfree_usr = pgfree_f;
 
+  // only the first PMEM_SIZE bytes are mapped for the kernel
+  if ((uintptr_t)_heap.end > PMEM_SIZE) {
+    _heap.end = (void *)PMEM_SIZE;
+  }
+
   int i;
 
   // make all PDEs invalid
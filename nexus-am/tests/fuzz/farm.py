@@ -0,0 +1,190 @@
+#!/usr/bin/python3
+
+# Differential fuzzing farm: generate random programs with instgen.py,
+# build them for x86-nemu and run them on NEMU on all host cores.
+# A case passes if NEMU hits the good trap, i.e. all the answers computed
+# natively by `gcc -m32' are reproduced. Failing cases are minimized and
+# saved into the output directory.
+
+import argparse, multiprocessing, os, random, re, shutil, subprocess, sys, time
+import instgen
+
+FUZZ_DIR = os.path.dirname(os.path.abspath(__file__))
+ARCH = "x86-nemu"
+VARS = ["x", "y", "z", "u", "v", "w"]
+
+MAKEFILE = "NAME = case\nSRCS = main.c\ninclude $(AM_HOME)/Makefile.app\n"
+
+args = None
+
+def case_dir(name):
+  return os.path.join(args.work, name)
+
+# build the AM program `code' in the directory `name', return the image
+def build(name, code):
+  d = case_dir(name)
+  if os.path.exists(d): shutil.rmtree(d)
+  os.makedirs(d)
+  shutil.copy(os.path.join(FUZZ_DIR, "trap.h"), d)
+  with open(os.path.join(d, "Makefile"), "w") as f: f.write(MAKEFILE)
+  with open(os.path.join(d, "main.c"), "w") as f: f.write(code)
+  p = subprocess.run(["make", "-s", "ARCH=" + ARCH], cwd = d,
+                     stdout = subprocess.PIPE, stderr = subprocess.STDOUT)
+  if p.returncode != 0:
+    raise Exception("Build {0} fail:\n{1}".format(d, p.stdout.decode(errors = "replace")))
+  return os.path.join(d, "build", "case-" + ARCH)
+
+# run the image on NEMU, return "GOOD", "BAD", "ABORT", "TIMEOUT" or "ERROR"
+def run_nemu(img):
+  cmd = [args.nemu, "-b", img]
+  if args.ref: cmd += ["-d", args.ref]
+  try:
+    p = subprocess.run(cmd, stdout = subprocess.PIPE, stderr = subprocess.STDOUT,
+                       timeout = args.timeout)
+  except subprocess.TimeoutExpired:
+    return "TIMEOUT"
+  out = p.stdout.decode(errors = "replace")
+  m = re.search(r"HIT (GOOD|BAD) TRAP", out)
+  if m: return m.group(1)
+  if "ABORT" in out: return "ABORT"
+  return "ERROR"
+
+def check(name, program, vs):
+  ans = instgen.native_answers(program, vs)
+  return run_nemu(build(name, instgen.am_program(program, vs, ans)))
+
+def gen_case(seed):
+  random.seed(seed)
+  return instgen.gen_program(args.blocks, args.arr_len, VARS)
+
+def run_case(seed):
+  name = "case-{0}".format(seed)
+  (program, vs) = gen_case(seed)
+  try:
+    result = check(name, program, vs)
+  except Exception as e:
+    result = "ERROR"
+    sys.stderr.write("{0}\n".format(e))
+  if result == "GOOD" and not args.keep:
+    shutil.rmtree(case_dir(name), ignore_errors = True)
+  return (seed, result)
+
+# The units which can be removed: assignments, and conditional gotos
+# with their conditions. Each unit is a list of line indices.
+def removable_units(program):
+  units = []
+  i = 0
+  while i < len(program):
+    line = program[i]
+    if line.startswith("  if ("):
+      units.append([i, i + 1])
+      i += 2
+      continue
+    if re.match(r"^  \S.* = .*;$", line):
+      units.append([i])
+    i += 1
+  return units
+
+# Remove as many units as possible while the case still fails (ddmin
+# with shrinking chunks). Return the minimized program and its result.
+def minimize(seed):
+  name = "min-{0}".format(seed)
+  (program, vs) = gen_case(seed)
+  result = check(name, program, vs)
+  if result == "GOOD": return (seed, program, vs, result)
+
+  units = removable_units(program)
+  chunk = max(len(units) // 2, 1)
+  while True:
+    i = 0
+    while i < len(units):
+      drop = set(l for u in units[i:i + chunk] for l in u)
+      cand = [l for (k, l) in enumerate(program) if k not in drop]
+      try:
+        r = check(name, cand, vs)
+      except Exception:
+        r = None
+      if r == result:
+        # still failing in the same way, the chunk is removed
+        program = cand
+        units = removable_units(program)
+      else:
+        i += chunk
+    if chunk == 1: break
+    chunk //= 2
+
+  check(name, program, vs)
+  return (seed, program, vs, result)
+
+def save_failure(seed):
+  d = os.path.join(args.out, "seed-{0}".format(seed))
+  if os.path.exists(d): shutil.rmtree(d)
+  shutil.copytree(case_dir("min-{0}".format(seed)), d,
+                  ignore = shutil.ignore_patterns("build"))
+  return d
+
+def init_worker(a):
+  global args
+  args = a
+
+def main():
+  global args
+  parser = argparse.ArgumentParser(description = "Parallel differential fuzzing farm for NEMU")
+  parser.add_argument("-n", "--cases", type = int, default = 1000, help = "number of cases")
+  parser.add_argument("-j", "--jobs", type = int, default = multiprocessing.cpu_count(),
+                      help = "number of parallel jobs")
+  parser.add_argument("-s", "--seed", type = int, default = int(time.time()),
+                      help = "seed of the first case, case i uses seed + i")
+  parser.add_argument("--blocks", type = int, default = 16, help = "basic blocks per program")
+  parser.add_argument("--arr-len", type = int, default = 3, help = "length of the global array")
+  parser.add_argument("--nemu", default = os.path.join(os.environ.get("NEMU_HOME", ""), "build", "nemu"),
+                      help = "the NEMU binary")
+  parser.add_argument("--ref", default = None,
+                      help = "run NEMU with difftest against this reference, e.g. build/nemu-so")
+  parser.add_argument("--timeout", type = float, default = 10, help = "timeout of NEMU in seconds")
+  parser.add_argument("--work", default = os.path.join(FUZZ_DIR, "build", "farm"), help = "work directory")
+  parser.add_argument("--out", default = os.path.join(FUZZ_DIR, "build", "failures"),
+                      help = "directory of the minimized failing cases")
+  parser.add_argument("--keep", action = "store_true", help = "keep the passing cases")
+  parser.add_argument("--no-minimize", action = "store_true", help = "do not minimize failing cases")
+  args = parser.parse_args()
+
+  if "AM_HOME" not in os.environ:
+    sys.exit("Environment variable AM_HOME must be defined.")
+  os.makedirs(args.work, exist_ok = True)
+  os.makedirs(args.out, exist_ok = True)
+
+  # build the libraries of AM once before the parallel builds
+  seeds = list(range(args.seed, args.seed + args.cases))
+  first = run_case(seeds[0])
+
+  results = [first]
+  start = time.time()
+  with multiprocessing.Pool(args.jobs, initializer = init_worker, initargs = (args,)) as pool:
+    for r in pool.imap_unordered(run_case, seeds[1:], chunksize = 4):
+      results.append(r)
+      if r[1] != "GOOD":
+        print("seed {0}: {1}".format(r[0], r[1]))
+      if len(results) % 100 == 0:
+        print("{0}/{1} cases, {2:.1f} cases/s".format(
+          len(results), args.cases, (len(results) - 1) / (time.time() - start)))
+    elapsed = time.time() - start
+
+    failed = [seed for (seed, r) in results if r != "GOOD"]
+    print("{0} cases, {1} failed, {2:.1f} cases/s with {3} jobs".format(
+      len(results), len(failed), (len(results) - 1) / max(elapsed, 1e-9), args.jobs))
+
+    # build errors are not minimized, since they are not failures of NEMU
+    to_minimize = [seed for (seed, r) in results if r not in ("GOOD", "ERROR")]
+    if to_minimize and not args.no_minimize:
+      for (seed, program, vs, result) in pool.imap_unordered(minimize, to_minimize):
+        if result == "GOOD":
+          print("seed {0}: not reproduced".format(seed))
+          continue
+        d = save_failure(seed)
+        print("seed {0}: {1}, minimized to {2} lines in {3}".format(seed, result, len(program), d))
+
+  sys.exit(1 if failed else 0)
+
+if __name__ == "__main__":
+  main()
@@ -1,15 +1,16 @@
 #!/usr/bin/python
 
-import random, tempfile, subprocess
+import random, tempfile, subprocess, os
 
 def execute(commands):
   p = subprocess.Popen(commands, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
   (out, err) = p.communicate()
   if p.returncode != 0:
     raise Exception("Execute {0} fail".format(' '.join(commands)))
-  return out
+  return out.decode()
 
-def gen(n, arr_len, var):
+# generate the lines of a random function f() and the variables it uses
+def gen_program(n, arr_len, var):
   VARS = [ "a[{0}]".format(i) for i in range(0, arr_len) ] + var
 
   program = []
@@ -91,7 +92,10 @@ u32 {1};
     
 
   program.append( '}\n' )
+  return (program, VARS)
 
+# compile the program natively and return the final values of the variables
+def native_answers(program, VARS):
   def gen_print():
     return '\n'.join( [ '  printf("0x%08x\\n", {0});'.format(v) for v in VARS ] + 
                       [ '  printf("%d\\n", S);' ])
@@ -107,14 +111,21 @@ int main() {
   f();
 ''' + gen_print() + "\n  return 0;\n}\n"
 
-  fp = tempfile.NamedTemporaryFile(suffix = ".c", delete = False)
+  fp = tempfile.NamedTemporaryFile(mode = "w", suffix = ".c", delete = False)
   fp.write(code_pr)
   fp.close()
 
   cfile = fp.name
-  execute(["gcc", "-m32", cfile, "-o", cfile + ".exe"])
-  ans = execute([cfile + ".exe"])
-
+  try:
+    execute(["gcc", "-m32", cfile, "-o", cfile + ".exe"])
+    ans = execute([cfile + ".exe"])
+  finally:
+    os.remove(cfile)
+    if os.path.exists(cfile + ".exe"): os.remove(cfile + ".exe")
+  return ans.strip().split('\n')
+
+# the AM program which checks the answers
+def am_program(program, VARS, ans):
   def gen_assert(ans):
     return '\n'.join( [ '  nemu_assert({0} == {1});'.format(v, a) for (v, a) in zip(VARS + ['S'], ans) ] )
 
@@ -128,10 +139,15 @@ u32 S = 0;
 ''' + '\n'.join(program) + '''
 int main() {
   f();
-''' + gen_assert(ans.strip().split('\n')) + '''
+''' + gen_assert(ans) + '''
   HIT_GOOD_TRAP;
   return 0;
 }
 '''
 
-print gen(16, 3, ["x", "y", "z", "u", "v", "w"])
+def gen(n, arr_len, var):
+  (program, VARS) = gen_program(n, arr_len, var)
+  return am_program(program, VARS, native_answers(program, VARS))
+
+if __name__ == "__main__":
+  print(gen(16, 3, ["x", "y", "z", "u", "v", "w"]))